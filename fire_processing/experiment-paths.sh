@@ -0,0 +1,17 @@
+
+data_dir=/mnt/data/firefly/data
+temp_dir_prefix=/mnt/data/firefly/data_temp
+results_dir=/mnt/data/firefly/data_results
+pds_name=MYD00F.A2015299.2110.20152992235.001.PDS
+pds_original=$data_dir/input/original/$pds_name
+#decoder_pipeline=/mnt/data/firefly/repo/decoder_pipeline
+decoder_pipeline=/home/josh/git/firefly/decoder_pipeline
+
+# Sets up the input directory of an experiment, apart from its masked PDS
+setup_experiment() {
+  temp_dir=$temp_dir_prefix/data_$1
+  mkdir $temp_dir
+  mkdir $temp_dir/input
+  cp $data_dir/input/leapsec.2022012900.dat $temp_dir/input/leapsec.2022012900.dat
+  cp $data_dir/input/utcpole.2022012900.dat $temp_dir/input/utcpole.2022012900.dat
+}
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# Sets up every experiment in an args file, and masks the fires for all of
+# them in a single pass over the original PDS
+# Usage: ./mask-experiments.sh args
+
+source $(dirname $0)/experiment-paths.sh
+
+args_file=$1
+
+for name in $(grep -v -E '^\s*(#|$)' $args_file | cut -d ' ' -f 1); do
+  setup_experiment $name
+done
+
+echo "Masking fires for every experiment in $args_file."
+cat $pds_original | modismaskfires --batch $args_file --output "$temp_dir_prefix/data_{}/input/$pds_name"
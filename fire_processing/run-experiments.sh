@@ -1,3 +1,5 @@
 #!/bin/bash
 
-cat args | parallel --ungroup --colsep ' ' './run-experiment.sh {}'
+# The fires are masked for every experiment at once, then each is decoded in parallel
+./mask-experiments.sh args
+grep -v -E '^\s*(#|$)' args | cut -d ' ' -f 1 | parallel --ungroup './run-experiment.sh --masked {}'
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "libcadu/file.h"
+#include "libcadu/index.h"
+#include "cadu_constants.h"
+
+// A capture opened for random access, either from a path given on the command
+// line or from a regular file on stdin, along with its sidecar index when it
+// has a valid one
+struct Capture {
+  std::unique_ptr<CaduFile> file;
+  std::optional<CaduIndex> index;
+
+  // Frames to operate on, in stream order, optionally only those on one virtual channel
+  auto select(std::optional<int> vcid) const -> std::vector<std::size_t> {
+    std::vector<std::size_t> frames;
+    frames.reserve(file->size());
+    for (std::size_t i = 0; i < file->size(); i++) {
+      if (!vcid) {
+        frames.push_back(i);
+      } else if (index) {
+        if ((*index)[i].vcid == *vcid) {
+          frames.push_back(i);
+        }
+      } else if (VcduHeader::decode((*file)[i].subspan(sizeof(cadu::SYNC_MARKER))).vcid == *vcid) {
+        frames.push_back(i);
+      }
+    }
+    return frames;
+  }
+};
+
+// Throws std::system_error if the capture could not be opened
+inline auto open_capture(std::optional<std::string> const & path) -> Capture {
+  Capture capture;
+  if (path) {
+    capture.index = CaduIndex::load(*path);
+    if (capture.index) {
+      capture.file = std::make_unique<CaduFile>(*path, capture.index->offsets());
+    } else {
+      capture.file = std::make_unique<CaduFile>(*path);
+    }
+  } else if (CaduFile::is_mappable(STDIN_FILENO)) {
+    capture.file = std::make_unique<CaduFile>(STDIN_FILENO);
+  }
+  return capture;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "libcadu/libcadu.h"
+
+// How a tool treats the checksums of the CADUs it passes through
+enum class ChecksumPolicy {
+  trust,     // Output checksums as they were read, doing no RS work
+  verify,    // Output checksums as they were read, but count those that don't match their frame
+  recompute, // Recalculate every checksum from the frame as it is output
+};
+
+// Throws std::invalid_argument with a message suitable for the user
+inline auto parse_checksum_policy(std::string const & value) -> ChecksumPolicy {
+  if (value == "trust") {
+    return ChecksumPolicy::trust;
+  } else if (value == "verify") {
+    return ChecksumPolicy::verify;
+  } else if (value == "recompute") {
+    return ChecksumPolicy::recompute;
+  }
+  throw std::invalid_argument("checksum must be either \"trust\", \"verify\", or \"recompute\"");
+}
+
+// Applies a checksum policy to each CADU before it is output
+// May be applied to different CADUs from several threads at once
+class ChecksumCheck {
+public:
+  explicit ChecksumCheck(ChecksumPolicy policy) : policy{policy} {}
+
+  auto trusted() const -> bool {
+    return policy == ChecksumPolicy::trust;
+  }
+
+  void operator()(CADU & cadu) {
+    switch (policy) {
+      case ChecksumPolicy::trust:
+        break;
+      case ChecksumPolicy::verify:
+        checked++;
+        if (!cadu._validate_checksum()) {
+          failed++;
+        }
+        break;
+      case ChecksumPolicy::recompute:
+        cadu.recalculate_checksum();
+        break;
+    }
+  }
+
+  // Reports the result of verification on stderr, if the policy was to verify
+  void report() const {
+    if (policy == ChecksumPolicy::verify) {
+      std::cerr << failed << " of " << checked << " CADUs failed checksum verification" << '\n';
+    }
+  }
+
+private:
+  ChecksumPolicy policy;
+  std::atomic<std::size_t> checked = 0;
+  std::atomic<std::size_t> failed = 0;
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+
+// One column of a ColumnWriter: a file of fixed-width little-endian unsigned integers
+class Column {
+public:
+  // Throws std::system_error if the file could not be created
+  Column(std::filesystem::path const & directory, std::string name, std::size_t width)
+    : name{std::move(name)}, width{width}, descriptor{open(directory / file())}, sink(descriptor.fd) {}
+
+  Column(Column const &) = delete;
+  auto operator=(Column const &) -> Column & = delete;
+
+  template <std::unsigned_integral T>
+  void put(T value) {
+    std::array<std::byte, sizeof(T)> bytes;
+    for (std::size_t i = 0; i < sizeof(T); i++) {
+      bytes[i] = static_cast<std::byte>(value >> (8 * i));
+    }
+    sink.write(bytes);
+    rows++;
+  }
+
+  void flush() {
+    sink.flush();
+  }
+
+  auto file() const -> std::string {
+    return name + ".bin";
+  }
+
+  // Type of the column as numpy describes it, e.g. <u4 for a 4 byte little-endian unsigned integer
+  auto dtype() const -> std::string {
+    return "<u" + std::to_string(width);
+  }
+
+  std::string const name;
+  std::size_t const width;
+  std::uint64_t rows = 0;
+
+private:
+  struct Descriptor {
+    int fd;
+
+    ~Descriptor() {
+      ::close(fd);
+    }
+  };
+
+  // The descriptor is closed after the sink, declared after it, has written
+  // out anything left
+  Descriptor descriptor;
+  OutputSink sink;
+
+  static auto open(std::filesystem::path const & path) -> int {
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "could not create " + path.string());
+    }
+    return fd;
+  }
+};
+
+// Writes the headers of CADUs to a directory as columns, one file per field
+// along with the byte offset of each frame and optionally whether its checksum
+// is valid, so they can be loaded in bulk without parsing, e.g. with
+// numpy.fromfile. schema.json in the same directory lists each column's file,
+// type and number of rows.
+class ColumnWriter {
+public:
+  // Throws std::system_error if the directory or its files could not be created
+  ColumnWriter(std::filesystem::path directory, bool validate)
+    : directory{create(directory)},
+      offset{this->directory, "offset", 8},
+      version_number{this->directory, "version_number", 1},
+      scid{this->directory, "scid", 1},
+      vcid{this->directory, "vcid", 1},
+      vcdu_counter{this->directory, "vcdu_counter", 4},
+      replay_flag{this->directory, "replay_flag", 1},
+      vcdu_spare{this->directory, "vcdu_spare", 1},
+      m_pdu_spare{this->directory, "m_pdu_spare", 1},
+      first_header_pointer{this->directory, "first_header_pointer", 2} {
+    if (validate) {
+      checksum_valid.emplace(this->directory, "checksum_valid", 1);
+    }
+  }
+
+  void add(CADU const & cadu, std::uint64_t frame_offset, std::optional<bool> valid) {
+    auto header = cadu.header();
+    offset.put(static_cast<std::uint64_t>(frame_offset));
+    version_number.put(static_cast<std::uint8_t>(header.version_number));
+    scid.put(static_cast<std::uint8_t>(header.scid));
+    vcid.put(static_cast<std::uint8_t>(header.vcid));
+    vcdu_counter.put(static_cast<std::uint32_t>(header.vcdu_counter));
+    replay_flag.put(static_cast<std::uint8_t>(header.replay_flag));
+    vcdu_spare.put(static_cast<std::uint8_t>(header.vcdu_spare));
+    m_pdu_spare.put(static_cast<std::uint8_t>(header.m_pdu_spare));
+    first_header_pointer.put(static_cast<std::uint16_t>(header.first_header_pointer));
+    if (checksum_valid) {
+      checksum_valid->put(static_cast<std::uint8_t>(valid.value_or(false)));
+    }
+  }
+
+  // Writes out every column, then the schema
+  // Throws std::system_error if anything could not be written
+  void finish() {
+    std::ofstream schema(directory / "schema.json", std::ios::trunc);
+    schema << "{\n  \"rows\": " << offset.rows << ",\n  \"columns\": [";
+    bool first = true;
+    for (auto * column : columns()) {
+      column->flush();
+      schema << (first ? "" : ",") << "\n    {\"name\": \"" << column->name
+             << "\", \"file\": \"" << column->file()
+             << "\", \"dtype\": \"" << column->dtype() << "\"}";
+      first = false;
+    }
+    schema << "\n  ]\n}\n";
+    if (!schema.flush()) {
+      throw std::system_error(errno, std::generic_category(), "could not write " + (directory / "schema.json").string());
+    }
+  }
+
+private:
+  std::filesystem::path directory;
+  Column offset;
+  Column version_number;
+  Column scid;
+  Column vcid;
+  Column vcdu_counter;
+  Column replay_flag;
+  Column vcdu_spare;
+  Column m_pdu_spare;
+  Column first_header_pointer;
+  std::optional<Column> checksum_valid;
+
+  static auto create(std::filesystem::path const & directory) -> std::filesystem::path {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+      throw std::system_error(error, "could not create " + directory.string());
+    }
+    return directory;
+  }
+
+  auto columns() -> std::vector<Column *> {
+    std::vector<Column *> all {
+      &offset, &version_number, &scid, &vcid, &vcdu_counter,
+      &replay_flag, &vcdu_spare, &m_pdu_spare, &first_header_pointer,
+    };
+    if (checksum_valid) {
+      all.push_back(&*checksum_valid);
+    }
+    return all;
+  }
+};
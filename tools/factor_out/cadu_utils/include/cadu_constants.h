@@ -1,25 +1,154 @@
-#include <map>
+#pragma once
 
-// constexpr std::array<std::tuple<std::stringview, int>>
-// Lookup: std::find (one of the ones in <algorithms>
-// Express this as a datastructure for this
-// Maybe use Jason Turner's
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 
-// TODO: should be constexpr, but there's no constexpr constructor for std::map
-std::map<std::string, int> SCIDs {
-  {"terra", 42},
-  {"aqua", 154}
+#include "libcadu/libcadu.h"
+
+struct NamedId {
+  std::string_view name;
+  int id;
 };
 
-// TODO: should be constexpr, but there's no constexpr constructor for std::map
-std::map<std::string, int> VCIDs {
-  {"aqua_gbad", 3},
-  {"aqua_ceres_10", 10},
-  {"aqua_ceres_15", 15},
-  {"aqua_amsu_20", 20},
-  {"aqua_amsu_25", 25},
-  {"aqua_modis", 30},
-  {"aqua_airs", 35},
-  {"aqua_amsr", 40},
-  {"aqua_hsb", 45}
+// A fixed table of names given to IDs, looked up in either direction without
+// allocating. Tables are small, so both lookups are a linear search, and can
+// be done at compile time.
+template <std::size_t N>
+class NameTable {
+public:
+  constexpr NameTable(std::array<NamedId, N> entries) : entries{entries} {}
+
+  constexpr auto id(std::string_view name) const -> std::optional<int> {
+    for (auto const & entry : entries) {
+      if (entry.name == name) {
+        return entry.id;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // The first name given to an ID
+  constexpr auto name(int id) const -> std::optional<std::string_view> {
+    for (auto const & entry : entries) {
+      if (entry.id == id) {
+        return entry.name;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Whether every name is unique and every ID fits in bits
+  constexpr auto valid(int bits) const -> bool {
+    for (std::size_t i = 0; i < N; i++) {
+      if (entries[i].id < 0 || entries[i].id >= (1 << bits)) {
+        return false;
+      }
+      for (std::size_t j = 0; j < i; j++) {
+        if (entries[i].name == entries[j].name) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // The names, in order, for help text: each one is put between prefix and
+  // suffix, and followed by separator
+  auto names(std::string_view separator, std::string_view prefix = "", std::string_view suffix = "") const -> std::string {
+    std::string joined;
+    for (auto const & entry : entries) {
+      joined.append(prefix).append(entry.name).append(suffix).append(separator);
+    }
+    return joined;
+  }
+
+  constexpr auto begin() const {
+    return entries.begin();
+  }
+
+  constexpr auto end() const {
+    return entries.end();
+  }
+
+private:
+  std::array<NamedId, N> entries;
 };
+
+constexpr NameTable SCIDs {std::array {
+  NamedId {"terra", 42},
+  NamedId {"aqua", 154},
+}};
+static_assert(SCIDs.valid(cadu::SCID_LEN));
+
+// Each is named after its spacecraft, as the same VCID is used differently on each
+constexpr NameTable VCIDs {std::array {
+  NamedId {"aqua_gbad", 3},
+  NamedId {"aqua_ceres_10", 10},
+  NamedId {"aqua_ceres_15", 15},
+  NamedId {"aqua_amsu_20", 20},
+  NamedId {"aqua_amsu_25", 25},
+  NamedId {"aqua_modis", 30},
+  NamedId {"aqua_airs", 35},
+  NamedId {"aqua_amsr", 40},
+  NamedId {"aqua_hsb", 45},
+}};
+static_assert(VCIDs.valid(cadu::VCID_LEN));
+
+// Name of a virtual channel on a spacecraft, if it has one
+constexpr auto vcid_name(int scid, int vcid) -> std::optional<std::string_view> {
+  auto spacecraft = SCIDs.name(scid);
+  auto channel = VCIDs.name(vcid);
+  if (spacecraft && channel && channel->starts_with(*spacecraft) && channel->substr(spacecraft->size()).starts_with('_')) {
+    return channel;
+  }
+  return std::nullopt;
+}
+static_assert(vcid_name(154, 30) == "aqua_modis");
+static_assert(!vcid_name(42, 30));
+
+// Choices of a field given by name or as an int, for help text
+template <std::size_t N>
+auto choices(NameTable<N> const & table, int bits) -> std::string {
+  return table.names("|") + "<int (0-" + std::to_string((1 << bits) - 1) + ")>";
+}
+
+// Parses a field given either by name in table or as an int of bits
+// Throws std::invalid_argument with a message suitable for the user
+template <std::size_t N>
+auto parse_named_id(std::string const & value, NameTable<N> const & table, std::string const & field, int bits) -> int {
+  if (auto id = table.id(value)) {
+    return *id;
+  }
+
+  int id;
+  try {
+    // The whole value must be the int, as stoi stops at the first character that isn't
+    std::size_t end;
+    id = std::stoi(value, &end);
+    if (end != value.size()) {
+      throw std::invalid_argument(value);
+    }
+  } catch (std::logic_error const &) {
+    throw std::invalid_argument(field + " must be either " + table.names(", ", "\"", "\"") + "or an int");
+  }
+  if (id < 0 || id >= (1 << bits)) {
+    throw std::invalid_argument(field + " must be between 0 and " + std::to_string((1 << bits) - 1));
+  }
+  return id;
+}
+
+// Parses a virtual channel given either by name or as an int
+// Throws std::invalid_argument with a message suitable for the user
+inline auto parse_vcid(std::string const & value) -> int {
+  return parse_named_id(value, VCIDs, "vcid", cadu::VCID_LEN);
+}
+
+// Parses a spacecraft given either by name or as an int
+// Throws std::invalid_argument with a message suitable for the user
+inline auto parse_scid(std::string const & value) -> int {
+  return parse_named_id(value, SCIDs, "scid", cadu::SCID_LEN);
+}
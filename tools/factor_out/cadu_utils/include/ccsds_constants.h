@@ -1,4 +1,11 @@
-// TODO: should be constexpr, but there's no constexpr constructor for std::map
-std::map<std::string, int> APP_IDs {
-  {"aqua_modis", 64}
-};
+#pragma once
+
+#include <array>
+
+#include "libcadu/packets.h"
+#include "cadu_constants.h"
+
+constexpr NameTable APP_IDs {std::array {
+  NamedId {"aqua_modis", 64},
+}};
+static_assert(APP_IDs.valid(cadu::APP_ID_LEN));
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <optional>
+#include <span>
+#include <cxxopts.hpp>
+
+#include <fcntl.h>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "libcadu/pipeline.h"
+
+// A frame along with where it was read from, and what correcting it found
+struct Correction {
+  CADU cadu;
+  std::uint64_t offset = 0;
+  std::array<int, cadu::rs::INTERLEAVE> corrected {};
+};
+
+struct Totals {
+  long frames = 0;
+  long corrected_frames = 0;
+  long corrected_symbols = 0;
+  long uncorrectable_frames = 0;
+};
+
+// Reports the result for one frame if it needed correcting, and adds it to the totals
+// Returns whether the frame was changed
+bool report(long frame, std::array<int, cadu::rs::INTERLEAVE> const & corrected, Totals & totals) {
+  totals.frames++;
+
+  bool changed = false;
+  bool uncorrectable = false;
+  for (auto count : corrected) {
+    changed |= count > 0;
+    uncorrectable |= count < 0;
+    totals.corrected_symbols += std::max(count, 0);
+  }
+  totals.corrected_frames += changed;
+  totals.uncorrectable_frames += uncorrectable;
+
+  if (changed || uncorrectable) {
+    std::cerr << frame;
+    for (auto count : corrected) {
+      std::cerr << '\t' << count;
+    }
+    std::cerr << '\n';
+  }
+  return changed;
+}
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options options("caducorrect", "Corrects errors in a nonrandomised CADU stream from stdin using the Reed-Solomon checksum, reporting each frame that needed correcting as its index followed by the number of symbols corrected in each of its four interleaved codewords (-1 if uncorrectable)");
+  options.add_options()
+    (
+      "f,file",
+      "Correct a capture file in place instead of copying stdin to stdout - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "t,threads",
+      "Number of threads used to correct frames - <int>",
+      cxxopts::value<unsigned>()->default_value("1")
+    )
+    ("h,help", "Print usage")
+    ;
+
+  auto result = options.parse(argc, argv);
+
+  // Show help menu
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    exit(0);
+  }
+
+  auto threads = result["threads"].as<unsigned>();
+  if (threads == 0) {
+    std::cerr << "Error: threads must be at least 1" << '\n';
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+
+  int fd = STDIN_FILENO;
+  bool in_place = result.count("file");
+  if (in_place) {
+    auto path = result["file"].as<std::string>();
+    fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+      std::cerr << "Error: could not open " << path << ": " << std::strerror(errno) << '\n';
+      exit(1);
+    }
+  }
+
+  CaduReader reader(fd);
+  std::optional<OutputSink> output;
+  if (!in_place) {
+    output.emplace(STDOUT_FILENO);
+  }
+  Totals totals;
+
+  // Frames are corrected on the pipeline's threads, and reported and written out in order
+  Pipeline<Correction> pipeline(threads, [](std::span<Correction> frames) {
+    for (auto & frame : frames) {
+      frame.corrected = frame.cadu.correct();
+    }
+  }, [&](std::span<Correction> frames) {
+    for (auto & frame : frames) {
+      auto changed = report(totals.frames, frame.corrected, totals);
+      if (in_place && changed) {
+        auto bytes = frame.cadu.bytes();
+        if (::pwrite(fd, bytes.data(), bytes.size(), frame.offset) != static_cast<ssize_t>(bytes.size())) {
+          std::cerr << "Error: could not write corrected frame " << totals.frames - 1 << ": " << std::strerror(errno) << '\n';
+          exit(1);
+        }
+      }
+      if (output) {
+        output->write(frame.cadu);
+      }
+    }
+  });
+
+  std::cerr << "frame\tcodeword-0\tcodeword-1\tcodeword-2\tcodeword-3" << '\n';
+  while (true) {
+    auto & chunk = pipeline.filling();
+    auto & frame = chunk.emplace_back();
+    if (!nonrandomised::operator>>(reader, frame.cadu)) {
+      chunk.pop_back();
+      break;
+    }
+    frame.offset = reader.offset();
+    if (chunk.size() == pipeline.chunk_size()) {
+      pipeline.submit();
+    }
+  }
+  pipeline.finish();
+  if (output) {
+    try {
+      output->flush();
+    } catch (std::system_error const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      exit(1);
+    }
+  }
+
+  std::cerr << totals.frames << " frames, "
+            << totals.corrected_frames << " corrected ("
+            << totals.corrected_symbols << " symbols), "
+            << totals.uncorrectable_frames << " uncorrectable" << '\n';
+
+  if (in_place) {
+    ::close(fd);
+  }
+}
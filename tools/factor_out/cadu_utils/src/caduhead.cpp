@@ -3,6 +3,9 @@
 #include <vector>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "cadu_capture.h"
+#include "cadu_checksum.h"
 
 template <typename It>
 class subrange {
@@ -30,6 +33,22 @@ int main(int argc, char *argv[]) {
       "Output CADUs up to index arg, indexing from the start of the stream. A leading '-' indexes from the end of the stream - <int>",
       cxxopts::value<std::string>()->default_value("10")
     )
+    (
+      "f,file",
+      "Read CADUs from a capture file instead of stdin, accessing only the frames that are output. Uses the capture's index from caduindex if it is up to date - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "i,vcid",
+      "Only count and output CADUs on this virtual channel - "
+        + choices(VCIDs, cadu::VCID_LEN),
+      cxxopts::value<std::string>()
+    )
+    (
+      "c,checksum",
+      "How to treat the checksums of the CADUs output: pass them through as read, verify them and report how many are wrong, or recalculate them - trust|verify|recompute",
+      cxxopts::value<std::string>()->default_value("trust")
+    )
     ("h,help", "Print usage")
     ;
 
@@ -70,18 +89,90 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  std::optional<int> vcid;
+  if (result.count("vcid")) {
+    try {
+      vcid = parse_vcid(result["vcid"].as<std::string>());
+    } catch (std::invalid_argument const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      valid = false;
+    }
+  }
+
+  ChecksumPolicy checksum_policy;
+  try {
+    checksum_policy = parse_checksum_policy(result["checksum"].as<std::string>());
+  } catch (std::invalid_argument const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    valid = false;
+  }
+
   if (!valid) {
     std::cerr << "Quitting..." << '\n';
     exit(1);
   }
 
+  ChecksumCheck checksums(checksum_policy);
+  OutputSink output(STDOUT_FILENO);
+
+  // Writes out what is left of the output, and reports how many checksums failed
+  auto finish = [&]() {
+    try {
+      output.flush();
+    } catch (std::system_error const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      exit(1);
+    }
+    checksums.report();
+  };
+
+  Capture capture;
+  try {
+    capture = open_capture(result.count("file") ? std::optional(result["file"].as<std::string>()) : std::nullopt);
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  if (capture.file) {
+    // Random access to the capture, so only the output frames are touched
+    auto output_frame = [&](std::size_t i) {
+      if (checksums.trusted()) {
+        auto frame = (*capture.file)[i];
+        output.write(frame);
+      } else {
+        auto cadu = capture.file->cadu(i);
+        checksums(cadu);
+        output.write(cadu);
+      }
+    };
+    if (!vcid) {
+      auto n = sign ? index : std::max(static_cast<int>(capture.file->size()) - index, 0);
+      for (int i = 0; i < std::min(n, static_cast<int>(capture.file->size())); i++) {
+        output_frame(i);
+      }
+    } else {
+      auto frames = capture.select(vcid);
+      auto n = sign ? std::min(index, static_cast<int>(frames.size())) : std::max(static_cast<int>(frames.size()) - index, 0);
+      for (int i = 0; i < n; i++) {
+        output_frame(frames[i]);
+      }
+    }
+    finish();
+    return 0;
+  }
+
+  CaduReader reader(STDIN_FILENO);
+  nonrandomised::_CADU cadu;
+
   if (sign) {
-    // TODO: this exhibits UB once we get to the end of the buffer!
-    std::copy_n
-      ( std::istream_iterator<nonrandomised::_CADU>(std::cin)
-      , index
-      , std::ostream_iterator<nonrandomised::_CADU>(std::cout)
-      );
+    for (int n = 0; n < index && reader >> cadu;) {
+      if (!vcid || cadu.vcid() == *vcid) {
+        checksums(cadu);
+        output.write(cadu);
+        n++;
+      }
+    }
 
     /*
     std::ranges::copy
@@ -107,20 +198,29 @@ int main(int argc, char *argv[]) {
       );
     */
 
+  } else if (index == 0) {
+    while (reader >> cadu) {
+      if (!vcid || cadu.vcid() == *vcid) {
+        checksums(cadu);
+        output.write(cadu);
+      }
+    }
   } else {
-    std::vector<nonrandomised::_CADU> buffer;
-    // Fill all the CADUs into a buffer
-    std::copy
-      ( std::istream_iterator<nonrandomised::_CADU>(std::cin)
-      , std::istream_iterator<nonrandomised::_CADU>()
-      , std::back_insert_iterator<std::vector<nonrandomised::_CADU>>(buffer)
-      );
-
-    // Output from the buffer
-    std::copy_n
-      ( buffer.begin()
-      , buffer.size() - index
-      , std::ostream_iterator<nonrandomised::_CADU>(std::cout)
-      );
+    // Delay the stream by index CADUs in a ring buffer, so the last index
+    // CADUs are never output
+    std::vector<CADU> buffer(index + 1);
+    for (int n = 0; nonrandomised::operator>>(reader, buffer.at(n%(index + 1)));) {
+      if (vcid && buffer.at(n%(index + 1)).vcid() != *vcid) {
+        // Overwritten by the next CADU
+        continue;
+      }
+      if (n++ >= index) {
+        auto & cadu = buffer.at((n - 1 - index)%(index + 1));
+        checksums(cadu);
+        output.write(cadu);
+      }
+    }
   }
+
+  finish();
 }
@@ -0,0 +1,42 @@
+#include <iostream>
+#include <cxxopts.hpp>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/index.h"
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options options("caduindex", "Builds a sidecar index (<file>.caduidx) of the frames in a CADU capture, used by caduhead, cadutail and caduinfo to seek without rescanning it");
+  options.add_options()
+    (
+      "f,file",
+      "Capture to index - <path>",
+      cxxopts::value<std::string>()
+    )
+    ("h,help", "Print usage")
+    ;
+  options.parse_positional({"file"});
+
+  auto result = options.parse(argc, argv);
+
+  // Show help menu
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    exit(0);
+  }
+
+  if (!result.count("file")) {
+    std::cerr << "Error: no capture file given" << '\n';
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+
+  auto path = result["file"].as<std::string>();
+  try {
+    auto index = CaduIndex::build(path);
+    index.save(path);
+    std::cerr << "Indexed " << index.size() << " CADUs into " << CaduIndex::path_for(path) << '\n';
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+}
@@ -1,8 +1,17 @@
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <vector>
 #include <cxxopts.hpp>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/pipeline.h"
+#include "cadu_capture.h"
+#include "cadu_columns.h"
 
 // TODO: select desired outputs through flags
 
@@ -19,9 +28,260 @@ void print_checksum(std::array<std::byte, 128> checksum, long unsigned int n_byt
   }
 }
 
+// With symbolic set, the spacecraft and virtual channel are shown by name where they have one
+void print_header(CADU const & cadu, std::optional<bool> valid, bool symbolic) {
+  auto header = cadu.header();
+  std::cout << header.version_number << "\t\t";
+  if (auto name = symbolic ? SCIDs.name(header.scid) : std::nullopt) {
+    std::cout << *name << "\t";
+  } else {
+    std::cout << header.scid << "\t";
+  }
+  if (auto name = symbolic ? vcid_name(header.scid, header.vcid) : std::nullopt) {
+    std::cout << *name << "\t";
+  } else {
+    std::cout << header.vcid << "\t";
+  }
+  std::cout << header.vcdu_counter << "\t\t"
+            << header.replay_flag << "\t\t"
+            << header.vcdu_spare << "\t\t"
+            << header.m_pdu_spare << "\t\t"
+            << header.first_header_pointer << "\t\t\t";
+  print_checksum(cadu.checksum(), 5);
+  if (valid) {
+    std::cout << "\t" << *valid;
+  }
+  std::cout << '\n';
+}
+
+enum class ChecksumResult : char {
+  passed,
+  corrected,
+  failed,
+};
+
+// Checks the checksum of a CADU, and if it is wrong, whether the frame could
+// be corrected, leaving the CADU as it is
+auto check_checksum(CADU const & cadu) -> ChecksumResult {
+  if (cadu._validate_checksum()) {
+    return ChecksumResult::passed;
+  }
+  auto copy = cadu;
+  auto corrected = copy.correct();
+  if (std::ranges::any_of(corrected, [](int count) { return count < 0; })) {
+    return ChecksumResult::failed;
+  }
+  return ChecksumResult::corrected;
+}
+
+// Statistics kept for each virtual channel by --summary
+struct ChannelSummary {
+  // First header pointers are counted in bins of this many bytes, followed by
+  // a bin for frames with no header and one for pointers past the data
+  static constexpr int FHP_BIN_LEN = 128;
+  static constexpr int FHP_BINS = (cadu::DATA_LEN + FHP_BIN_LEN - 1) / FHP_BIN_LEN;
+
+  std::uint64_t frames = 0;
+  std::uint64_t repeats = 0; // Frames with the same counter as the one before
+  std::uint64_t gaps = 0;
+  std::uint64_t frames_lost = 0;
+  std::uint64_t wraps = 0;
+  std::uint64_t backward = 0; // Steps back that aren't the counter wrapping
+  std::uint64_t replays = 0;
+  std::array<std::uint64_t, 3> checksums {}; // Indexed by ChecksumResult
+  std::array<std::uint64_t, FHP_BINS + 2> first_header_pointers {};
+  std::optional<int> last_counter;
+
+  // A step that would lose this many frames or more, half the counter's range,
+  // is taken as the counter going backwards, which is the shorter way round. A
+  // wrap is then only counted when the counter steps forwards past its maximum.
+  static constexpr int MAX_GAP = 1 << (cadu::VCDU_COUNTER_LEN - 1);
+
+  void add(VcduHeader const & header) {
+    constexpr int COUNTER_MASK = (1 << cadu::VCDU_COUNTER_LEN) - 1;
+
+    frames++;
+    if (last_counter) {
+      auto lost = (header.vcdu_counter - *last_counter - 1) & COUNTER_MASK;
+      if (header.vcdu_counter == *last_counter) {
+        repeats++;
+      } else if (lost >= MAX_GAP) {
+        backward++;
+      } else {
+        if (header.vcdu_counter < *last_counter) {
+          wraps++;
+        }
+        if (lost > 0) {
+          gaps++;
+          frames_lost += lost;
+        }
+      }
+    }
+    last_counter = header.vcdu_counter;
+    replays += header.replay_flag;
+
+    auto fhp = header.first_header_pointer;
+    if (fhp < cadu::DATA_LEN) {
+      first_header_pointers[fhp / FHP_BIN_LEN]++;
+    } else if (fhp == (1 << cadu::FIRST_HEADER_POINTER_LEN) - 1) {
+      first_header_pointers[FHP_BINS]++;
+    } else {
+      first_header_pointers[FHP_BINS + 1]++;
+    }
+  }
+};
+
+// Prints the statistics of each virtual channel seen, and over all of them
+void print_summary(std::array<ChannelSummary, 1 << cadu::VCID_LEN> const & channels, bool validate) {
+  std::cout << "vcid\tframes\trepeats\tgaps\tframes-lost\twraps\tbackward\treplays"
+            << (validate ? "\tchecksum-passed\tchecksum-corrected\tchecksum-failed" : "") << '\n';
+  ChannelSummary total;
+  for (std::size_t vcid = 0; vcid < channels.size(); vcid++) {
+    auto const & channel = channels[vcid];
+    if (channel.frames == 0) {
+      continue;
+    }
+    std::cout << vcid << '\t' << channel.frames << '\t' << channel.repeats << '\t' << channel.gaps << '\t' << channel.frames_lost
+              << '\t' << channel.wraps << '\t' << channel.backward << '\t' << channel.replays;
+    if (validate) {
+      for (auto count : channel.checksums) {
+        std::cout << '\t' << count;
+      }
+    }
+    std::cout << '\n';
+
+    total.frames += channel.frames;
+    total.repeats += channel.repeats;
+    total.gaps += channel.gaps;
+    total.frames_lost += channel.frames_lost;
+    total.wraps += channel.wraps;
+    total.backward += channel.backward;
+    total.replays += channel.replays;
+    for (std::size_t i = 0; i < total.checksums.size(); i++) {
+      total.checksums[i] += channel.checksums[i];
+    }
+  }
+  std::cout << "total\t" << total.frames << '\t' << total.repeats << '\t' << total.gaps << '\t' << total.frames_lost
+            << '\t' << total.wraps << '\t' << total.backward << '\t' << total.replays;
+  if (validate) {
+    for (auto count : total.checksums) {
+      std::cout << '\t' << count;
+    }
+  }
+  std::cout << '\n';
+
+  auto fill = channels[cadu::FILL_VCID].frames;
+  std::cout << '\n' << "fill-frames\t" << fill << '\t'
+            << (total.frames ? static_cast<double>(fill) / total.frames : 0.0) << '\n';
+
+  std::cout << '\n' << "vcid";
+  for (int bin = 0; bin < ChannelSummary::FHP_BINS; bin++) {
+    std::cout << "\tfhp-" << bin * ChannelSummary::FHP_BIN_LEN << '-'
+              << std::min((bin + 1) * ChannelSummary::FHP_BIN_LEN, cadu::DATA_LEN) - 1;
+  }
+  std::cout << "\tfhp-none\tfhp-invalid" << '\n';
+  for (std::size_t vcid = 0; vcid < channels.size(); vcid++) {
+    if (channels[vcid].frames == 0) {
+      continue;
+    }
+    std::cout << vcid;
+    for (auto count : channels[vcid].first_header_pointers) {
+      std::cout << '\t' << count;
+    }
+    std::cout << '\n';
+  }
+}
+
+// Summarises every frame in a single pass, decoding only their headers unless
+// checksums are to be validated
+void summarise(Capture const & capture, std::optional<int> vcid, bool validate, unsigned threads) {
+  std::array<ChannelSummary, 1 << cadu::VCID_LEN> channels;
+
+  // Calls visit with the bytes following the sync marker of each frame
+  auto for_each_frame = [&](auto && visit) {
+    if (capture.file) {
+      capture.file->advise(MADV_SEQUENTIAL);
+      for (std::size_t i = 0; i < capture.file->size(); i++) {
+        visit((*capture.file)[i].subspan(sizeof(cadu::SYNC_MARKER)));
+      }
+    } else {
+      CaduReader reader(STDIN_FILENO);
+      while (auto frame = reader.next()) {
+        visit(*frame);
+      }
+    }
+  };
+
+  if (!validate) {
+    for_each_frame([&](std::span<std::byte const> frame) {
+      auto header = VcduHeader::decode(frame);
+      if (!vcid || header.vcid == *vcid) {
+        channels[header.vcid].add(header);
+      }
+    });
+  } else {
+    // Checksums are checked on the pipeline's threads, and the frames counted in order
+    struct Checked {
+      VcduHeader header;
+      CADU cadu;
+      ChecksumResult result;
+    };
+    Pipeline<Checked> pipeline(threads, [](std::span<Checked> frames) {
+      for (auto & frame : frames) {
+        frame.result = check_checksum(frame.cadu);
+      }
+    }, [&](std::span<Checked> frames) {
+      for (auto const & frame : frames) {
+        auto & channel = channels[frame.header.vcid];
+        channel.add(frame.header);
+        channel.checksums[static_cast<int>(frame.result)]++;
+      }
+    });
+    for_each_frame([&](std::span<std::byte const> frame) {
+      auto header = VcduHeader::decode(frame);
+      if (vcid && header.vcid != *vcid) {
+        return;
+      }
+      auto & chunk = pipeline.filling();
+      chunk.push_back({header, CADU(reinterpret_cast<uint8_t const *>(frame.data())), ChecksumResult::failed});
+      if (chunk.size() == pipeline.chunk_size()) {
+        pipeline.submit();
+      }
+    });
+    pipeline.finish();
+  }
+
+  print_summary(channels, validate);
+}
+
 int main(int argc, char *argv[]) {
   cxxopts::Options options("caduinfo", "Displays the header contents of a CADU stream from stdin");
   options.add_options()
+    (
+      "f,file",
+      "Read CADUs from a capture file instead of stdin. Uses the capture's index from caduindex if it is up to date - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "i,vcid",
+      "Only display CADUs on this virtual channel - "
+        + choices(VCIDs, cadu::VCID_LEN),
+      cxxopts::value<std::string>()
+    )
+    ("drop-fill", "Don't display fill CADUs")
+    ("symbolic", "Display the spacecraft and virtual channel of each CADU by name, where they have one")
+    ("v,validate", "Validate the checksum of each CADU, adding a column that is 1 if it is valid")
+    ("s,summary", "Instead of a line per CADU, output statistics for each virtual channel: frame counts, VCDU counter repeats, gaps, wraps and steps backwards, replays, first header pointers, the share of fill frames, and with --validate how many checksums passed, could be corrected, or failed")
+    (
+      "c,columns",
+      "Instead of a line per CADU, write each header field to a directory as a column of fixed-width little-endian integers, along with the byte offset of each CADU and with --validate whether its checksum is valid. The directory's schema.json lists the files and their types, for loading e.g. with numpy.fromfile - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "t,threads",
+      "Number of threads used to validate checksums - <int>",
+      cxxopts::value<unsigned>()->default_value("1")
+    )
     ("h,help", "Print usage")
     ;
 
@@ -33,18 +293,120 @@ int main(int argc, char *argv[]) {
     exit(0);
   }
 
-  nonrandomised::_CADU cadu;
-  std::cerr << "version-number\tscid\tvcid\tvcdu-counter\treplay-flag\tvcdu-spare\tm-pdu-spare\tfirst-header-pointer\tchecksum" << '\n';
-  while (std::cin >> cadu) {
-    std::cout << cadu.version_number() << "\t\t"
-              << cadu.scid() << "\t"
-              << cadu.vcid() << "\t"
-              << cadu.vcdu_counter() << "\t\t"
-              << cadu.replay_flag() << "\t\t"
-              << cadu.vcdu_spare() << "\t\t"
-              << cadu.m_pdu_spare() << "\t\t"
-              << cadu.first_header_pointer() << "\t\t\t";
-    print_checksum(cadu.checksum(), 5);
-    std::cout << '\n';
+  bool valid = true;
+
+  std::optional<int> vcid;
+  if (result.count("vcid")) {
+    try {
+      vcid = parse_vcid(result["vcid"].as<std::string>());
+    } catch (std::invalid_argument const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      valid = false;
+    }
+  }
+
+  auto threads = result["threads"].as<unsigned>();
+  if (threads == 0) {
+    std::cerr << "Error: threads must be at least 1" << '\n';
+    valid = false;
+  }
+
+  if (!valid) {
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+
+  bool validate = result.count("validate");
+  bool drop_fill = result.count("drop-fill");
+  bool symbolic = result.count("symbolic");
+
+  Capture capture;
+  try {
+    capture = open_capture(result.count("file") ? std::optional(result["file"].as<std::string>()) : std::nullopt);
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  if (result.count("summary")) {
+    summarise(capture, vcid, validate, threads);
+    return 0;
+  }
+
+  std::optional<ColumnWriter> columns;
+  if (result.count("columns")) {
+    try {
+      columns.emplace(result["columns"].as<std::string>(), validate);
+    } catch (std::system_error const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      exit(1);
+    }
+  } else {
+    std::cerr << "version-number\tscid\tvcid\tvcdu-counter\treplay-flag\tvcdu-spare\tm-pdu-spare\tfirst-header-pointer\tchecksum"
+              << (validate ? "\tchecksum-valid" : "") << '\n';
+  }
+
+  // Checksums are validated on the pipeline's threads, and the CADUs output in order
+  struct Line {
+    CADU cadu;
+    std::uint64_t offset;
+    std::optional<bool> valid;
+  };
+  Pipeline<Line> pipeline(threads, [validate](std::span<Line> lines) {
+    if (validate) {
+      for (auto & line : lines) {
+        line.valid = line.cadu._validate_checksum();
+      }
+    }
+  }, [&](std::span<Line> lines) {
+    for (auto const & line : lines) {
+      if (columns) {
+        columns->add(line.cadu, line.offset, line.valid);
+      } else {
+        print_header(line.cadu, line.valid, symbolic);
+      }
+    }
+  });
+  auto add = [&pipeline](CADU const & cadu, std::uint64_t offset) {
+    auto & chunk = pipeline.filling();
+    chunk.push_back({cadu, offset, std::nullopt});
+    if (chunk.size() == pipeline.chunk_size()) {
+      pipeline.submit();
+    }
+  };
+
+  try {
+    if (capture.file) {
+      if (!vcid || !capture.index) {
+        capture.file->advise(MADV_SEQUENTIAL);
+      }
+      for (auto i : capture.select(vcid)) {
+        auto cadu = capture.file->cadu(i);
+        if (!(drop_fill && cadu.is_fill())) {
+          add(cadu, capture.file->offset(i));
+        }
+      }
+    } else {
+      CaduReader reader(STDIN_FILENO);
+      nonrandomised::_CADU cadu;
+      while (reader >> cadu) {
+        if ((!vcid || cadu.vcid() == *vcid) && !(drop_fill && cadu.is_fill())) {
+          add(cadu, reader.offset());
+        }
+      }
+    }
+    pipeline.finish();
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  if (columns) {
+    try {
+      columns->finish();
+    } catch (std::system_error const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      exit(1);
+    }
   }
 }
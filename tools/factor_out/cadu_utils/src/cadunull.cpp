@@ -1,11 +1,21 @@
 #include <iostream>
+#include <span>
+#include <vector>
 #include <cxxopts.hpp>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "cadu_checksum.h"
 
 int main(int argc, char *argv[]) {
   cxxopts::Options options("cadurandomise", "Applies the randomisation polynomial to a CADU stream on stdin");
   options.add_options()
+    (
+      "c,checksum",
+      "How to treat the checksums of the CADUs output: pass them through as read, verify them and report how many are wrong, or recalculate them - trust|verify|recompute",
+      cxxopts::value<std::string>()->default_value("trust")
+    )
+    ("direct", "Bypass the page cache when stdout is a file, for outputs far larger than memory")
     ("h,help", "Print usage")
     ;
 
@@ -17,8 +27,39 @@ int main(int argc, char *argv[]) {
     exit(0);
   }
   
-  CADU cadu;
-  while (randomised::operator>>(std::cin, cadu)) {
-    nonrandomised::operator<<(std::cout, cadu);
+  ChecksumPolicy checksum_policy;
+  try {
+    checksum_policy = parse_checksum_policy(result["checksum"].as<std::string>());
+  } catch (std::invalid_argument const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
   }
+  ChecksumCheck checksums(checksum_policy);
+
+  // Derandomise in batches, so the whole batch goes through the randomiser together
+  constexpr std::size_t BATCH_SIZE = 256;
+  std::vector<CADU> batch(BATCH_SIZE);
+  CaduReader reader(STDIN_FILENO);
+  OutputSink output(STDOUT_FILENO, result.count("direct"));
+  try {
+    while (reader) {
+      std::size_t n = 0;
+      while (n < batch.size() && nonrandomised::operator>>(reader, batch[n])) {
+        n++;
+      }
+      auto frames = std::span(batch).first(n);
+      CADU::randomise_all(frames);
+      for (auto &cadu : frames) {
+        checksums(cadu);
+      }
+      output.write(std::span<CADU const>(frames));
+    }
+    output.flush();
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  checksums.report();
 }
@@ -1,9 +1,13 @@
 #include <algorithm>
 #include <iostream>
+#include <span>
+#include <vector>
 #include <cxxopts.hpp>
 #include <math.h>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "libcadu/pipeline.h"
 #include "cadu_constants.h"
 #include "libccsds/libccsds.h"
 
@@ -13,6 +17,77 @@ std::ostream& operator<< (std::ostream& os, std::byte b) {
   return os << std::bitset<8>(std::to_integer<int>(b));
 }
 
+// Packs CADUs in place into chunks of frame slots, which have their parity
+// calculated on the pipeline's threads while the next chunks are packed.
+// Chunks are written out in order, straight from their slots.
+// flush() must be called once everything is packed, as nothing is written out
+// on destruction, which may be while an exception from writing is unwinding.
+class BatchWriter {
+public:
+  BatchWriter(OutputSink &output, unsigned threads)
+    : pipeline(threads, CADU::recalculate_checksums, [&output](std::span<CADU> chunk) {
+        output.write(std::span<CADU const>(chunk));
+      }) {}
+
+  // Starts a new frame as a copy of prototype, to be packed in place
+  // The frame remains valid until it is finished or discarded
+  auto start(CADU const &prototype) -> CADU & {
+    return pipeline.filling().emplace_back(prototype);
+  }
+
+  // Queues the frame last started to be written out
+  void finish() {
+    if (pipeline.filling().size() == pipeline.chunk_size()) {
+      pipeline.submit();
+    }
+  }
+
+  // Drops the frame last started
+  void discard() {
+    pipeline.filling().pop_back();
+  }
+
+  void flush() {
+    pipeline.finish();
+  }
+
+private:
+  Pipeline<CADU> pipeline;
+};
+
+// Fill packet long enough to complete any CADU, even one it has to be split
+// over, built once. Fill packets of any length are a prefix of it, with the
+// packet length field patched.
+class FillPacket {
+public:
+  FillPacket() {
+    // Construct a packet will all the magic values that mark it as a fill packet
+    // I believe this is an ICD_Space_Ground_Aqua document thing, rather than a CCSDS thing
+    CCSDSPacket fill_packet;
+    fill_packet.version_number() = 0;
+    fill_packet.type() = 0;
+    fill_packet.sec_hdr_flag() = 0;
+    fill_packet.app_id() = (1 << ccsds::APP_ID_LEN) - 1;
+    fill_packet.seq_flags() = (1 << ccsds::SEQ_FLAGS_LEN) - 1;
+    fill_packet.seq_cnt_or_name() = 0;
+    fill_packet.data() = std::vector<std::byte>(cadu::DATA_LEN*2 - sizeof(CCSDSPrimaryHeader), std::byte(0x00));
+    bytes.assign(fill_packet.begin(), fill_packet.end());
+  }
+
+  // A fill packet length bytes long, header included
+  auto packet(std::size_t length) -> std::span<std::byte const> {
+    // The packet data length field is the last two bytes of the primary header,
+    // and holds one less than the length of the packet data field
+    auto data_length = length - sizeof(CCSDSPrimaryHeader) - 1;
+    bytes[sizeof(CCSDSPrimaryHeader) - 2] = std::byte(data_length >> 8);
+    bytes[sizeof(CCSDSPrimaryHeader) - 1] = std::byte(data_length & 0xff);
+    return std::span(bytes).first(length);
+  }
+
+private:
+  std::vector<std::byte> bytes;
+};
+
 int main(int argc, char *argv[]) {
   cxxopts::Options options("cadupack", "Pack bytes from stdin into a CADU stream on stdout");
   options.add_options()
@@ -30,16 +105,14 @@ int main(int argc, char *argv[]) {
     )
     (
       "s,scid",
-      "Set spacecraft ID field - terra|aqua|<int (0-"
-        + std::to_string((int)std::pow(2, cadu::SCID_LEN)-1)
-        + ")>",
+      "Set spacecraft ID field - "
+        + choices(SCIDs, cadu::SCID_LEN),
       cxxopts::value<std::string>()->default_value("0")
     )
     (
       "i,vcid",
-      "Set virtual channel (instrument) field - aqua_gbad|aqua_ceres_10|aqua_ceres_15|aqua_amsu_20|aqua_amsu_25|aqua_modis|aqua_airs|aqua_amsr|aqua_hsb|<int (0-"
-        + std::to_string((int)std::pow(2, cadu::VCID_LEN)-1)
-        + ")>",
+      "Set virtual channel (instrument) field - "
+        + choices(VCIDs, cadu::VCID_LEN),
       cxxopts::value<std::string>()->default_value("0")
     )
     (
@@ -77,6 +150,12 @@ int main(int argc, char *argv[]) {
         + ")>",
       cxxopts::value<int>()->default_value("0")
     )
+    (
+      "t,threads",
+      "Number of threads used to calculate Reed-Solomon parity - <int>",
+      cxxopts::value<unsigned>()->default_value("1")
+    )
+    ("direct", "Bypass the page cache when stdout is a file, for outputs far larger than memory")
     ("h,help", "Print usage")
     ;
 
@@ -103,51 +182,19 @@ int main(int argc, char *argv[]) {
   }
 
   int scid;
-  try{
-    scid = SCIDs.at(result["scid"].as<std::string>());
-  }
-  catch(std::out_of_range) {
-    try {
-      scid = std::stoi(result["scid"].as<std::string>());
-      if (scid >= std::pow(2, cadu::SCID_LEN)) {
-        std::cerr << "Error: scid must be between 0 and " << std::pow(2, cadu::SCID_LEN)-1 << '\n';
-        valid = false;
-      }
-    }
-    catch(std::invalid_argument) {
-      // TODO: create this dynamically at compile time
-      std::cerr << "Error: scid must be either \"terra\", \"aqua\", or an int" << '\n';
-      valid = false;
-    }
-    catch(std::out_of_range) {
-      std::cerr << "Error: scid out of range" << '\n';
-      valid = false;
-    }
+  try {
+    scid = parse_scid(result["scid"].as<std::string>());
+  } catch (std::invalid_argument const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    valid = false;
   }
 
   int vcid;
   try {
-    vcid = VCIDs.at(result["vcid"].as<std::string>());
-  }
-  catch(std::out_of_range) {
-    // There was no VCID with this name
-    try {
-      // Attempt to use the ID as an integer
-      vcid = std::stoi(result["vcid"].as<std::string>());
-      if (vcid >= std::pow(2, cadu::VCID_LEN)) {
-        std::cerr << "Error: vcid must be between 0 and " << std::pow(2, cadu::VCID_LEN)-1 << '\n';
-        valid = false;
-      }
-    }
-    catch(std::invalid_argument) {
-      // TODO: create this dynamically at compile time
-      std::cerr << "Error: vcid must be either \"aqua_gbad\", \"aqua_ceres_10\", \"aqua_ceres_15\", \"aqua_amsu_20\", \"aqua_amsu_25\", \"aqua_modis\", \"aqua_airs\", \"aqua_amsr\", \"aqua_hsb\", or an int" << '\n';
-      valid = false;
-    }
-    catch(std::out_of_range) {
-      std::cerr << "Error: vcid out of range" << '\n';
-      valid = false;
-    }
+    vcid = parse_vcid(result["vcid"].as<std::string>());
+  } catch (std::invalid_argument const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    valid = false;
   }
 
   if (result["vcdu-counter"].as<int>() >= std::pow(2, cadu::VCDU_COUNTER_LEN)) {
@@ -175,194 +222,164 @@ int main(int argc, char *argv[]) {
     valid = false;
   }
 
+  if (result["threads"].as<unsigned>() == 0) {
+    std::cerr << "Error: threads must be at least 1" << '\n';
+    valid = false;
+  }
+
   if (!valid) {
     std::cerr << "Quitting..." << '\n';
     exit(1);
   }
 
-  auto buffer = std::remove_cvref_t<decltype(std::declval<CADU>().data())>();
-  auto vcdu_counter = result["vcdu-counter"].as<int>();
+  auto threads = result["threads"].as<unsigned>();
+  OutputSink sink(STDOUT_FILENO, result.count("direct"));
+  BatchWriter output(sink, threads);
+  FillPacket fill;
 
+  // Each frame starts as a copy of this, so only the fields that change between frames are set on it
   nonrandomised::_CADU cadu;
-  cadu.version_number() = result["version-number"].as<int>();
-  cadu.scid() = scid;
-  cadu.vcid() = vcid;
-  cadu.vcdu_counter() = vcdu_counter;
-  cadu.replay_flag() = result["replay-flag"].as<int>();
-  cadu.vcdu_spare() = result["vcdu-spare"].as<int>();
-  cadu.m_pdu_spare() = result["m-pdu-spare"].as<int>();
-  cadu.first_header_pointer() = result["first-header-pointer"].as<int>();
-
-  if (mode == "raw") {
-    while (std::cin.read(reinterpret_cast<char*>(buffer.data()), cadu::DATA_LEN) || std::cin.gcount() > 0) {
-      if (std::cin.gcount() < cadu::DATA_LEN) {
-        // If insufficient characters read, pad with zeros
-        std::fill(buffer.begin() + std::cin.gcount(), buffer.end(), std::byte{0});
-      }
-
-      cadu.data() = buffer;
-      std::cout << cadu;
-
-      ++vcdu_counter; // TODO: roll over correctly
-    }
-  } else if (mode == "ccsds") {
-    CCSDSPacket packet;
-    int next_byte_offset = result["first-header-pointer"].as<int>();
-
-    cadu.first_header_pointer() = next_byte_offset;
-
-    while (std::cin >> packet) {
-      // std::cerr << "found packet of size " << packet.size() << '\n';
-      int packet_offset = 0; // The number of bytes of the packet that have been copied in so far
-      while (packet_offset != packet.size()) {
-        if (packet.size() - packet_offset <= cadu::DATA_LEN - next_byte_offset) {
-          // The entire remaining packet fits within the CADU
-          // std::cerr << "packet fits within the CADU" << '\n';
-          std::copy(
-            packet.begin() + packet_offset,
-            packet.end(),
-            buffer.begin() + next_byte_offset);
+  cadu.set_header({
+    .version_number = result["version-number"].as<int>(),
+    .scid = scid,
+    .vcid = vcid,
+    .vcdu_counter = result["vcdu-counter"].as<int>(),
+    .replay_flag = result["replay-flag"].as<int>(),
+    .vcdu_spare = result["vcdu-spare"].as<int>(),
+    .m_pdu_spare = result["m-pdu-spare"].as<int>(),
+    .first_header_pointer = result["first-header-pointer"].as<int>(),
+  });
+
+  // Writing can fail part way through as well as at the end
+  try {
+    if (mode == "raw") {
+      while (true) {
+        // Read straight into the frame
+        auto & frame = output.start(cadu);
+        auto data = frame.mutable_data();
+        std::cin.read(reinterpret_cast<char*>(data.data()), data.size());
+        if (std::cin.gcount() == 0) {
+          output.discard();
+          break;
+        }
+        if (std::cin.gcount() < cadu::DATA_LEN) {
+          // If insufficient characters read, pad with zeros
+          std::fill(data.begin() + std::cin.gcount(), data.end(), std::byte{0});
+        }
+        output.finish();
 
-          next_byte_offset += packet.size() - packet_offset;
-          packet_offset = packet.size();
-        } else {
-          // std::cerr << "packet does not fit within the CADU" << '\n';
-          if (cadu::DATA_LEN - next_byte_offset > 0) {
-            // There is still space in the CADU
-
-            // TODO: why doesn't copy_n work?
-            /*
-            std::copy_n(
-              packet.begin() + packet_offset,
-              cadu::DATA_LEN - next_byte_offset,
-              buffer.begin() + next_byte_offset);
-            */
-
-            std::copy(
-              packet.begin() + packet_offset,
-              packet.begin() + packet_offset + (cadu::DATA_LEN - next_byte_offset),
-              buffer.begin() + next_byte_offset);
-
-            packet_offset += cadu::DATA_LEN - next_byte_offset;
+        cadu.increment_vcdu_counter();
+      }
+    } else if (mode == "ccsds") {
+      CCSDSPacket packet;
+      int next_byte_offset = result["first-header-pointer"].as<int>();
+
+      cadu.first_header_pointer() = next_byte_offset;
+      auto * frame = &output.start(cadu);
+      auto data = frame->mutable_data();
+
+      // Finishes the current frame and starts the next, with the given first header pointer
+      auto next_frame = [&](int first_header_pointer) {
+        output.finish();
+        cadu.increment_vcdu_counter();
+        cadu.first_header_pointer() = first_header_pointer;
+        frame = &output.start(cadu);
+        data = frame->mutable_data();
+        next_byte_offset = 0;
+      };
+
+      while (std::cin >> packet) {
+        int packet_offset = 0; // The number of bytes of the packet that have been copied in so far
+        while (packet_offset != packet.size()) {
+          if (next_byte_offset == cadu::DATA_LEN) {
+            // The CADU is full, so the rest of the packet goes in the next one
+            int remaining = packet.size() - packet_offset;
+            if (packet_offset == 0) {
+              // The packet starts the next CADU
+              next_frame(0);
+            } else if (remaining >= cadu::DATA_LEN) {
+              // The packet is going to fill up the entire next CADU as well
+              // so there will be no first header
+              next_frame(std::pow(2, cadu::FIRST_HEADER_POINTER_LEN)-1);
+            } else {
+              // The packet will end in the next CADU, with the next header after it
+              next_frame(remaining);
+            }
           }
 
-          // The CADU is now entirely full - output it
-          cadu.data() = buffer;
-          std::cout << cadu;
-          // std::cerr << "outputting full cadu" << '\n';
-
-          // Create a "new" cadu
-          next_byte_offset = 0;
-          cadu.vcdu_counter() = (cadu.vcdu_counter() + 1) % (1 << cadu::VCDU_COUNTER_LEN);
-          if (packet.size() - packet_offset > cadu::DATA_LEN) {
-            // The packet is going to fill up the entire next CADU as well
-            // so there will be no first header
-            cadu.first_header_pointer() = std::pow(2, cadu::FIRST_HEADER_POINTER_LEN)-1;
-          } else {
-            // The packet will be contained in the next CADU
-            // so the next header will be in the next CADU
-            // TODO: this may not be true for the final CADU
-            cadu.first_header_pointer() = packet.size() - packet_offset;
-          }
+          // Copy as much of the packet as fits straight into the frame
+          int n = std::min<int>(packet.size() - packet_offset, cadu::DATA_LEN - next_byte_offset);
+          std::copy_n(packet.begin() + packet_offset, n, data.begin() + next_byte_offset);
+          packet_offset += n;
+          next_byte_offset += n;
         }
       }
-    }
-
-    if (next_byte_offset > 0) {
-      // The final CADU is only partially filled, add a fill packet
-      // TODO: work out whether this packet needs to be within the bounds of the spacecraft's min and max
-
-      // Construct a packet will all the magic values that mark it as a fill packet
-      // I believe this is an ICD_Space_Ground_Aqua document thing, rather than a CCSDS thing
-      CCSDSPacket fill_packet;
-      fill_packet.version_number() = 0;
-      fill_packet.type() = 0;
-      fill_packet.sec_hdr_flag() = 0;
-      fill_packet.app_id() = (1 << ccsds::APP_ID_LEN) - 1;
-      fill_packet.seq_flags() = (1 << ccsds::SEQ_FLAGS_LEN) - 1;
-      fill_packet.seq_cnt_or_name() = 0;
-
-      std::cerr << "working on final cadu\n";
-      if (cadu::DATA_LEN - next_byte_offset >= ccsds::MIN_PACKET_LEN) {
-        std::cerr << "fill packet fits\n";
-        // There's sufficient space in the CADU for a fill packet
-        // Construct it and copy into the packet
-        std::vector<std::byte> packet_buffer(cadu::DATA_LEN - next_byte_offset - sizeof(CCSDSPrimaryHeader), std::byte(0x00));
-        fill_packet.data() = packet_buffer;
-        //buffer.begin() + next_byte_offset << 
-        std::copy(fill_packet.begin(), fill_packet.end(), buffer.begin() + next_byte_offset);
 
+      if (next_byte_offset == 0) {
+        // Nothing was packed
+        output.discard();
+      } else if (next_byte_offset == cadu::DATA_LEN) {
+        // The last packet filled the final CADU exactly, so no fill is needed.
+        // This used to be treated as a partial CADU with no room for a fill
+        // packet, adding a CADU of nothing but fill, with a first header pointer
+        // of "no header" even though the fill packet's header started it
+        output.finish();
       } else {
-        // There's insufficient space in the CADU to store a fill packet
-        // Construct an extra-long one and copy the first part into the packet
-        std::vector<std::byte> packet_buffer(cadu::DATA_LEN*2 - next_byte_offset - sizeof(CCSDSPrimaryHeader), std::byte(0x00));
-        fill_packet.data() = packet_buffer;
-        std::copy(
-          fill_packet.begin(),
-          fill_packet.begin() + (cadu::DATA_LEN - next_byte_offset),
-          buffer.begin() + next_byte_offset);
-
-        // Output the cadu
-        cadu.data() = buffer;
-        std::cout << cadu;
-
-        // Construct the second CADU
-        cadu.first_header_pointer() = (1 << cadu::FIRST_HEADER_POINTER_LEN) - 1;
-        cadu.vcdu_counter() = (cadu.vcdu_counter() + 1) % (1 << cadu::VCDU_COUNTER_LEN);
-        std::copy(
-          fill_packet.begin() + (cadu::DATA_LEN - next_byte_offset),
-          fill_packet.end(),
-          buffer.begin());
+        // The final CADU is only partially filled, add a fill packet
+        // TODO: work out whether this packet needs to be within the bounds of the spacecraft's min and max
+        int space = cadu::DATA_LEN - next_byte_offset;
+        if (space >= ccsds::MIN_PACKET_LEN) {
+          // There's sufficient space in the CADU for a fill packet
+          std::ranges::copy(fill.packet(space), data.begin() + next_byte_offset);
+        } else {
+          // There's insufficient space in the CADU to store a fill packet
+          // Use an extra-long one, which fills the whole of the next CADU as well
+          auto packet = fill.packet(space + cadu::DATA_LEN);
+          std::ranges::copy(packet.first(space), data.begin() + next_byte_offset);
+          next_frame((1 << cadu::FIRST_HEADER_POINTER_LEN) - 1);
+          std::ranges::copy(packet.subspan(space), data.begin());
+        }
+        output.finish();
       }
+    } else if (mode == "ccsdspad") {
+      CCSDSPacket packet;
+      int next_byte_offset = result["first-header-pointer"].as<int>();
 
-      // Output the cadu
-      cadu.data() = buffer;
-      std::cout << cadu;
-    }
-  } else if (mode == "ccsdspad") {
-    CCSDSPacket packet;
-    int next_byte_offset = result["first-header-pointer"].as<int>();
-
-    cadu.first_header_pointer() = next_byte_offset;
-
-    while (std::cin >> packet) {
-      // Check that there's enough length in the CADU to fit the packet and a fill packet if required
-      if (cadu::DATA_LEN - next_byte_offset != packet.size()
-         && cadu::DATA_LEN - next_byte_offset < packet.size() + ccsds::MIN_PACKET_LEN) {
-        std::cerr << "Packet size too large to be padded into a frame. Skipping...\n";
-      } else {
-        std::copy(
-          packet.begin(),
-          packet.end(),
-          buffer.begin() + next_byte_offset);
-
-        // Construct the fill packet if required
-        if (cadu::DATA_LEN - next_byte_offset != packet.size()) {
-          CCSDSPacket fill_packet;
-          fill_packet.version_number() = 0;
-          fill_packet.type() = 0;
-          fill_packet.sec_hdr_flag() = 0;
-          fill_packet.app_id() = (1 << ccsds::APP_ID_LEN) - 1;
-          fill_packet.seq_flags() = (1 << ccsds::SEQ_FLAGS_LEN) - 1;
-          fill_packet.seq_cnt_or_name() = 0;
-          std::vector<std::byte> packet_buffer(cadu::DATA_LEN - next_byte_offset - packet.size() - sizeof(CCSDSPrimaryHeader), std::byte(0x00));
-          fill_packet.data() = packet_buffer;
+      cadu.first_header_pointer() = next_byte_offset;
 
+      while (std::cin >> packet) {
+        // Check that there's enough length in the CADU to fit the packet and a fill packet if required
+        if (cadu::DATA_LEN - next_byte_offset != packet.size()
+           && cadu::DATA_LEN - next_byte_offset < packet.size() + ccsds::MIN_PACKET_LEN) {
+          std::cerr << "Packet size too large to be padded into a frame. Skipping...\n";
+        } else {
+          auto & frame = output.start(cadu);
+          auto data = frame.mutable_data();
           std::copy(
-            fill_packet.begin(),
-            fill_packet.end(),
-            buffer.begin() + packet.size());
-        }
+            packet.begin(),
+            packet.end(),
+            data.begin() + next_byte_offset);
 
-        // Output the cadu
-        cadu.data() = buffer;
-        std::cout << cadu;
+          // Pad with a fill packet if required
+          if (cadu::DATA_LEN - next_byte_offset != packet.size()) {
+            std::ranges::copy(
+              fill.packet(cadu::DATA_LEN - next_byte_offset - packet.size()),
+              data.begin() + next_byte_offset + packet.size());
+          }
+          output.finish();
 
-        // Construct the next CADU
-        cadu.vcdu_counter() = (cadu.vcdu_counter() + 1) % (1 << cadu::VCDU_COUNTER_LEN);
+          // Construct the next CADU
+          cadu.increment_vcdu_counter();
+        }
       }
+    } else {
+      throw std::invalid_argument("Error: invalid mode: " + mode);
     }
-  } else {
-    throw std::invalid_argument("Error: invalid mode: " + mode);
+
+    output.flush();
+    sink.flush();
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
   }
 }
@@ -1,11 +1,26 @@
 #include <iostream>
+#include <span>
 #include <cxxopts.hpp>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "libcadu/pipeline.h"
+#include "cadu_checksum.h"
 
 int main(int argc, char *argv[]) {
   cxxopts::Options options("cadurandomise", "Applies the randomisation polynomial to a CADU stream on stdin");
   options.add_options()
+    (
+      "c,checksum",
+      "How to treat the checksums of the CADUs output: pass them through as read, verify them and report how many are wrong, or recalculate them - trust|verify|recompute",
+      cxxopts::value<std::string>()->default_value("trust")
+    )
+    (
+      "t,threads",
+      "Number of threads used to randomise, and to verify or recalculate checksums - <int>",
+      cxxopts::value<unsigned>()->default_value("1")
+    )
+    ("direct", "Bypass the page cache when stdout is a file, for outputs far larger than memory")
     ("h,help", "Print usage")
     ;
 
@@ -17,9 +32,47 @@ int main(int argc, char *argv[]) {
     exit(0);
   }
 
-  std::copy
-    ( std::istream_iterator<randomised::_CADU>(std::cin)
-    , std::istream_iterator<randomised::_CADU>()
-    , std::ostream_iterator<nonrandomised::_CADU>(std::cout)
-    );
+  bool valid = true;
+
+  ChecksumPolicy checksum_policy;
+  try {
+    checksum_policy = parse_checksum_policy(result["checksum"].as<std::string>());
+  } catch (std::invalid_argument const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    valid = false;
+  }
+
+  auto threads = result["threads"].as<unsigned>();
+  if (threads == 0) {
+    std::cerr << "Error: threads must be at least 1" << '\n';
+    valid = false;
+  }
+
+  if (!valid) {
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+  ChecksumCheck checksums(checksum_policy);
+
+  // Each chunk goes through the randomiser together, on one of the pipeline's threads
+  OutputSink output(STDOUT_FILENO, result.count("direct"));
+  Pipeline<CADU> pipeline(threads, [&checksums](std::span<CADU> frames) {
+    CADU::randomise_all(frames);
+    for (auto &cadu : frames) {
+      checksums(cadu);
+    }
+  }, [&output](std::span<CADU> frames) {
+    output.write(std::span<CADU const>(frames));
+  });
+
+  CaduReader reader(STDIN_FILENO);
+  try {
+    pipeline.read(reader);
+    output.flush();
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  checksums.report();
 }
@@ -0,0 +1,326 @@
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <cxxopts.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "cadu_capture.h"
+
+// An output of the router, written by its own thread from a bounded queue of
+// batches, so a slow output only holds up the reader once its queue is full
+class Channel {
+public:
+  Channel(std::string name, int fd, bool owned, bool direct, std::size_t queue_depth)
+    : name{std::move(name)}, descriptor{fd, owned}, output(fd, direct), queue_depth{queue_depth},
+      writer([this] { write(); }) {}
+
+  ~Channel() {
+    close();
+  }
+
+  // Queues a batch, waiting while the queue is full
+  void push(std::vector<CADU> batch) {
+    frames += batch.size();
+    std::unique_lock lock(mutex);
+    space_available.wait(lock, [this] { return batches.size() < queue_depth || failed; });
+    if (failed) {
+      return;
+    }
+    batches.push_back(std::move(batch));
+    batch_available.notify_one();
+  }
+
+  // Writes out everything queued and waits for the writer to finish
+  void close() {
+    {
+      std::lock_guard lock(mutex);
+      closed = true;
+    }
+    batch_available.notify_one();
+    if (writer.joinable()) {
+      writer.join();
+    }
+  }
+
+  std::string const name;
+  std::size_t frames = 0;
+  std::exception_ptr error;
+
+private:
+  // Closes the file descriptor, if the channel opened it
+  struct Descriptor {
+    int fd;
+    bool owned;
+
+    ~Descriptor() {
+      if (owned) {
+        ::close(fd);
+      }
+    }
+  };
+
+  // The descriptor is closed after the output, declared after it, has written
+  // out anything left
+  Descriptor descriptor;
+  OutputSink output;
+  std::size_t queue_depth;
+
+  std::mutex mutex;
+  std::condition_variable batch_available;
+  std::condition_variable space_available;
+  std::deque<std::vector<CADU>> batches;
+  bool closed = false;
+  bool failed = false;
+
+  std::jthread writer;
+
+  void write() {
+    try {
+      while (true) {
+        std::vector<CADU> batch;
+        {
+          std::unique_lock lock(mutex);
+          batch_available.wait(lock, [this] { return !batches.empty() || closed; });
+          if (batches.empty()) {
+            break;
+          }
+          batch = std::move(batches.front());
+          batches.pop_front();
+        }
+        space_available.notify_one();
+        output.write(std::span<CADU const>(batch));
+      }
+      output.flush();
+    } catch (...) {
+      // Stop taking batches, so the reader never waits on this channel again
+      error = std::current_exception();
+      std::lock_guard lock(mutex);
+      failed = true;
+      batches.clear();
+      space_available.notify_one();
+    }
+  }
+};
+
+// Parses a destination, which is a path, "-" for stdout, or "&N" for an
+// already open file descriptor N, as in the shell
+// Throws std::invalid_argument or std::system_error with a message suitable for the user
+auto open_destination(std::string const & destination) -> std::pair<int, bool> {
+  if (destination == "-") {
+    return {STDOUT_FILENO, false};
+  }
+  if (destination.starts_with("&")) {
+    int fd;
+    try {
+      fd = std::stoi(destination.substr(1));
+    } catch (std::logic_error const &) {
+      throw std::invalid_argument("file descriptor must be an int: " + destination);
+    }
+    if (::fcntl(fd, F_GETFD) < 0) {
+      throw std::system_error(errno, std::generic_category(), "could not use file descriptor " + destination.substr(1));
+    }
+    return {fd, false};
+  }
+  auto fd = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "could not open " + destination);
+  }
+  return {fd, true};
+}
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options options("cadurouter", "Splits a CADU stream from stdin by spacecraft and virtual channel in a single pass, writing each channel to its own output");
+  options.add_options()
+    (
+      "routes",
+      "Where to write the CADUs of a channel, as [scid:]vcid=destination. The scid and vcid are given by name or as an int, and a route with a scid takes priority over one without. The destination is a path, - for stdout, or &N for an open file descriptor N. Routes with the same destination share an output - <route>...",
+      cxxopts::value<std::vector<std::string>>()
+    )
+    (
+      "u,unrouted",
+      "Write CADUs matching no route here instead of discarding them - <destination>",
+      cxxopts::value<std::string>()
+    )
+    ("drop-fill", "Discard fill CADUs, even when a route matches them")
+    (
+      "q,queue",
+      "Number of batches of CADUs that may wait to be written to each output before reading is held up - <int>",
+      cxxopts::value<int>()->default_value("16")
+    )
+    ("direct", "Bypass the page cache for outputs that are files, for outputs far larger than memory")
+    ("h,help", "Print usage")
+    ;
+  options.parse_positional({"routes"});
+  options.positional_help("[scid:]vcid=destination...");
+
+  auto result = options.parse(argc, argv);
+
+  // Show help menu
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    exit(0);
+  }
+
+  bool valid = true;
+
+  auto queue_depth = result["queue"].as<int>();
+  if (queue_depth < 1) {
+    std::cerr << "Error: queue must be at least 1" << '\n';
+    valid = false;
+  }
+
+  struct Route {
+    std::optional<int> scid;
+    int vcid;
+    std::string destination;
+  };
+  std::vector<Route> routes;
+  if (result.count("routes")) {
+    for (auto const & route : result["routes"].as<std::vector<std::string>>()) {
+      auto equals = route.find('=');
+      if (equals == std::string::npos) {
+        std::cerr << "Error: route must be [scid:]vcid=destination: " << route << '\n';
+        valid = false;
+        continue;
+      }
+      auto channel = route.substr(0, equals);
+      auto colon = channel.find(':');
+      try {
+        routes.push_back({
+          colon == std::string::npos ? std::nullopt : std::optional(parse_scid(channel.substr(0, colon))),
+          parse_vcid(colon == std::string::npos ? channel : channel.substr(colon + 1)),
+          route.substr(equals + 1),
+        });
+      } catch (std::invalid_argument const& ex) {
+        std::cerr << "Error: " << ex.what() << '\n';
+        valid = false;
+      }
+    }
+  }
+
+  if (routes.empty() && !result.count("unrouted")) {
+    std::cerr << "Error: at least one route or an unrouted destination must be given" << '\n';
+    valid = false;
+  }
+
+  if (!valid) {
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+
+  bool drop_fill = result.count("drop-fill");
+  bool direct = result.count("direct");
+
+  // Open each destination once, however many routes it has
+  std::vector<std::unique_ptr<Channel>> channels;
+  std::map<std::string, int> channel_of;
+  auto open_channel = [&](std::string const & destination) {
+    if (!channel_of.contains(destination)) {
+      auto [fd, owned] = open_destination(destination);
+      channel_of[destination] = channels.size();
+      channels.push_back(std::make_unique<Channel>(destination, fd, owned, direct, queue_depth));
+    }
+    return channel_of[destination];
+  };
+
+  // Channel to write each CADU to, indexed by scid then vcid, or -1 to discard it
+  constexpr int CHANNEL_IDS = 1 << (cadu::SCID_LEN + cadu::VCID_LEN);
+  auto table = std::make_unique<std::array<int, CHANNEL_IDS>>();
+  try {
+    table->fill(result.count("unrouted") ? open_channel(result["unrouted"].as<std::string>()) : -1);
+    for (bool specific : {false, true}) {
+      for (auto const & route : routes) {
+        if (route.scid.has_value() != specific) {
+          continue;
+        }
+        auto channel = open_channel(route.destination);
+        for (int scid = 0; scid < (1 << cadu::SCID_LEN); scid++) {
+          if (!route.scid || *route.scid == scid) {
+            (*table)[scid << cadu::VCID_LEN | route.vcid] = channel;
+          }
+        }
+      }
+    }
+  } catch (std::exception const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+
+  // CADUs are gathered per channel and handed over a batch at a time
+  constexpr std::size_t BATCH_SIZE = 256;
+  std::vector<std::vector<CADU>> pending(channels.size());
+  for (auto & batch : pending) {
+    batch.reserve(BATCH_SIZE);
+  }
+
+  std::size_t fill = 0;
+  std::size_t discarded = 0;
+  CaduReader reader(STDIN_FILENO);
+  CADU cadu;
+  while (nonrandomised::operator>>(reader, cadu)) {
+    if (cadu.is_fill()) {
+      fill++;
+      if (drop_fill) {
+        continue;
+      }
+    }
+
+    auto channel = (*table)[cadu.scid() << cadu::VCID_LEN | cadu.vcid()];
+    if (channel < 0) {
+      discarded++;
+      continue;
+    }
+
+    auto & batch = pending[channel];
+    batch.push_back(cadu);
+    if (batch.size() == BATCH_SIZE) {
+      channels[channel]->push(std::move(batch));
+      batch = std::vector<CADU>();
+      batch.reserve(BATCH_SIZE);
+    }
+  }
+
+  bool failed = false;
+  for (std::size_t i = 0; i < channels.size(); i++) {
+    if (!pending[i].empty()) {
+      channels[i]->push(std::move(pending[i]));
+    }
+    channels[i]->close();
+    if (channels[i]->error) {
+      try {
+        std::rethrow_exception(channels[i]->error);
+      } catch (std::exception const& ex) {
+        std::cerr << "Error: " << channels[i]->name << ": " << ex.what() << '\n';
+      }
+      failed = true;
+    }
+  }
+
+  for (auto const & channel : channels) {
+    std::cerr << channel->name << ": " << channel->frames << " CADUs" << '\n';
+  }
+  std::cerr << "Discarded " << discarded << " unrouted CADUs" << '\n';
+  std::cerr << (drop_fill ? "Dropped " : "Read ") << fill << " fill CADUs" << '\n';
+
+  if (failed) {
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+}
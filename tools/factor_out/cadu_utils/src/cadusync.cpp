@@ -0,0 +1,92 @@
+#include <iostream>
+#include <cxxopts.hpp>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "libcadu/sync.h"
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options options("cadusync", "Finds CADUs at any bit offset in a raw bitstream on stdin, such as demodulator output, and outputs them byte-aligned");
+  options.add_options()
+    (
+      "e,errors",
+      "Number of bits of a sync marker allowed to be wrong once locked - <int (0-15)>",
+      cxxopts::value<int>()->default_value("0")
+    )
+    (
+      "search-errors",
+      "Number of bits of a sync marker allowed to be wrong while searching for lock. Raising this makes locking onto random data more likely, and searching slower - <int (0-15)>",
+      cxxopts::value<int>()->default_value("0")
+    )
+    (
+      "s,slip",
+      "Number of bits a frame may slip by either way and remain locked - <int>",
+      cxxopts::value<int>()->default_value("1")
+    )
+    ("p,inverted", "Also find frames received with inverted phase, and invert them back")
+    ("direct", "Bypass the page cache when stdout is a file, for outputs far larger than memory")
+    ("h,help", "Print usage")
+    ;
+
+  auto result = options.parse(argc, argv);
+
+  // Show help menu
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    exit(0);
+  }
+
+  bool valid = true;
+
+  // Any more and an inverted marker could match as well as an upright one
+  constexpr int MAX_ERRORS = sizeof(cadu::SYNC_MARKER) * 8 / 2 - 1;
+
+  auto errors = result["errors"].as<int>();
+  if (errors < 0 || errors > MAX_ERRORS) {
+    std::cerr << "Error: errors must be between 0 and " << MAX_ERRORS << '\n';
+    valid = false;
+  }
+
+  auto search_errors = result["search-errors"].as<int>();
+  if (search_errors < 0 || search_errors > MAX_ERRORS) {
+    std::cerr << "Error: search-errors must be between 0 and " << MAX_ERRORS << '\n';
+    valid = false;
+  }
+
+  auto slip = result["slip"].as<int>();
+  if (slip < 0 || slip > 64) {
+    std::cerr << "Error: slip must be between 0 and 64" << '\n';
+    valid = false;
+  }
+
+  if (!valid) {
+    std::cerr << "Quitting..." << '\n';
+    exit(1);
+  }
+
+  BitSynchroniser synchroniser(STDIN_FILENO, {
+    .max_errors = errors,
+    .search_errors = search_errors,
+    .inverted = static_cast<bool>(result.count("inverted")),
+    .slip = slip,
+  });
+
+  OutputSink output(STDOUT_FILENO, result.count("direct"));
+  while (auto frame = synchroniser.next()) {
+    output.write(*frame);
+  }
+
+  try {
+    output.flush();
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  auto const & stats = synchroniser.statistics();
+  std::cerr << "Synchronised " << stats.frames << " CADUs: "
+            << stats.acquisitions << " acquisitions, "
+            << stats.slips << " slips, "
+            << stats.inverted << " inverted, "
+            << stats.marker_errors << " sync marker bit errors" << '\n';
+}
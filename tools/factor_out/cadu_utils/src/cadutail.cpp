@@ -4,6 +4,9 @@
 #include <vector>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "cadu_capture.h"
+#include "cadu_checksum.h"
 
 int main(int argc, char *argv[]) {
   cxxopts::Options options("cadutail", "Output the last part of a CADU stream from stdin, in whole CADUs, from a given index");
@@ -13,6 +16,22 @@ int main(int argc, char *argv[]) {
       "Output CADUs from index arg, indexing from the end of the stream. A leading '+' indexes from the start of the stream - <int>",
       cxxopts::value<std::string>()->default_value("10")
     )
+    (
+      "f,file",
+      "Read CADUs from a capture file instead of stdin, accessing only the frames that are output. Uses the capture's index from caduindex if it is up to date - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "i,vcid",
+      "Only count and output CADUs on this virtual channel - "
+        + choices(VCIDs, cadu::VCID_LEN),
+      cxxopts::value<std::string>()
+    )
+    (
+      "c,checksum",
+      "How to treat the checksums of the CADUs output: pass them through as read, verify them and report how many are wrong, or recalculate them - trust|verify|recompute",
+      cxxopts::value<std::string>()->default_value("trust")
+    )
     ("h,help", "Print usage")
     ;
 
@@ -53,6 +72,24 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  std::optional<int> vcid;
+  if (result.count("vcid")) {
+    try {
+      vcid = parse_vcid(result["vcid"].as<std::string>());
+    } catch (std::invalid_argument const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      valid = false;
+    }
+  }
+
+  ChecksumPolicy checksum_policy;
+  try {
+    checksum_policy = parse_checksum_policy(result["checksum"].as<std::string>());
+  } catch (std::invalid_argument const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    valid = false;
+  }
+
   if (!valid) {
     std::cerr << "Quitting..." << '\n';
     exit(1);
@@ -60,35 +97,99 @@ int main(int argc, char *argv[]) {
 
   // Set the index to be from the back by default, as in POSIX `tail`
 
+  ChecksumCheck checksums(checksum_policy);
+  OutputSink output(STDOUT_FILENO);
+
+  // Writes out what is left of the output, and reports how many checksums failed
+  auto finish = [&]() {
+    try {
+      output.flush();
+    } catch (std::system_error const& ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      exit(1);
+    }
+    checksums.report();
+  };
+
+  Capture capture;
+  try {
+    capture = open_capture(result.count("file") ? std::optional(result["file"].as<std::string>()) : std::nullopt);
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  if (capture.file) {
+    // Random access to the capture, so only the output frames are touched
+    auto output_frame = [&](std::size_t i) {
+      if (checksums.trusted()) {
+        auto frame = (*capture.file)[i];
+        output.write(frame);
+      } else {
+        auto cadu = capture.file->cadu(i);
+        checksums(cadu);
+        output.write(cadu);
+      }
+    };
+    if (!vcid) {
+      auto size = capture.file->size();
+      auto count = static_cast<std::size_t>(index);
+      auto first = sign ? count : size - std::min(count, size);
+      for (auto i = first; i < size; i++) {
+        output_frame(i);
+      }
+    } else {
+      auto frames = capture.select(vcid);
+      auto count = std::min(static_cast<std::size_t>(index), frames.size());
+      auto first = sign ? count : frames.size() - count;
+      for (auto i = first; i < frames.size(); i++) {
+        output_frame(frames[i]);
+      }
+    }
+    finish();
+    return 0;
+  }
+
+  CaduReader reader(STDIN_FILENO);
 
   if (sign) {
     // Positive sign
     int n = 0;
     nonrandomised::_CADU cadu;
-    while (std::cin >> cadu) {
+    while (reader >> cadu) {
+      if (vcid && cadu.vcid() != *vcid) {
+        continue;
+      }
       if (n < index) {
         n++;
       } else {
         // No need to increment n
-        nonrandomised::operator<<(std::cout, cadu);
+        checksums(cadu);
+        output.write(cadu);
       }
     }
   } else {
     if (index != 0) {
       // Negative sign
-      std::vector<CADU> buffer(index);
-      buffer.reserve(index);
+      // One spare slot, so a CADU on another virtual channel never overwrites a kept one
+      std::vector<CADU> buffer(index + 1);
 
       // Read the last index elements into a ring buffer
       int n = 0;
-      while (nonrandomised::operator>>(std::cin, buffer.at(n%index))) {
-        n++;
+      while (nonrandomised::operator>>(reader, buffer.at(n%(index + 1)))) {
+        if (!vcid || buffer.at(n%(index + 1)).vcid() == *vcid) {
+          n++;
+        }
       }
 
       // Read the last elements out of the buffer
       for (int i = 0; i < std::min(n, index); i++) {
-        nonrandomised::operator<<(std::cout, buffer.at((n - std::min(n, index) + i)%index));
+        auto & cadu = buffer.at((n - std::min(n, index) + i)%(index + 1));
+        checksums(cadu);
+        output.write(cadu);
       }
     }
   }
+
+  finish();
 }
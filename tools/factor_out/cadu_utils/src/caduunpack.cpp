@@ -1,37 +1,24 @@
 // Given a stream of CADUs on stdin, extracts and outputs the stream of CCSDS packets on stdout
 
-#include <cmath>
 #include <iostream>
+#include <span>
 #include <cxxopts.hpp>
 
 #include "libcadu/libcadu.h"
+#include "libcadu/output.h"
+#include "libcadu/packets.h"
 
 
-void report_discarded_bytes(const int discarded_cadus, const int discarded_bytes) {
-  if (discarded_cadus == 1) {
-    std::cerr << "First CADU contained no first header and was discarded" << '\n';
-  } else if (discarded_cadus > 1) {
-    std::cerr << "First " << discarded_cadus << " CADUs contained no first header and were discarded" << '\n';
-  }
-
-  if (discarded_bytes > 0) {
-    if (discarded_cadus == 0) {
-      std::cerr << "First CADU contained " << discarded_bytes << " bytes before first-header-pointer which were discarded" << '\n';
-    } else {
-      std::cerr << "The subsequent CADU contained " << discarded_bytes << " bytes before first-header-pointer which were discarded" << '\n';
-
-    }
-  }
-}
-
 int main(int argc, char *argv[]) {
   cxxopts::Options options("caduunpack", "Unpack a CADU stream from stdin to stdout");
   options.add_options()
     (
       "m,mode",
-      "Choose between raw byte stream and CCSDS packet mode. raw unpacks all bytes from all the input CADUs.  ccsds discards prefixing bytes from a previous packet - raw|ccsds",
+      "Choose between raw byte stream and CCSDS packet mode. raw unpacks all bytes from all the input CADUs.  ccsds reassembles whole packets on each virtual channel, discarding those broken by missing CADUs - raw|ccsds",
       cxxopts::value<std::string>()->default_value("raw")
     )
+    ("drop-fill", "Discard fill CADUs, and in ccsds mode fill packets, so no fill bytes are output")
+    ("direct", "Bypass the page cache when stdout is a file, for outputs far larger than memory")
     ("h,help", "Print usage")
     ;
 
@@ -57,67 +44,62 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
+  bool drop_fill = result.count("drop-fill");
+
+  CaduReader reader(STDIN_FILENO);
+  OutputSink output(STDOUT_FILENO, result.count("direct"));
   nonrandomised::_CADU cadu;
+  int fill_cadus = 0;
 
   if (mode == "raw") {
     // Unpack all the bytes within the CADU
-    while (std::cin >> cadu) {
-      for (auto&& it : cadu.data()) {
-        std::cout << static_cast<const uint8_t>(it);
+    while (reader >> cadu) {
+      if (drop_fill && cadu.is_fill()) {
+        fill_cadus++;
+        continue;
       }
+      output.write(cadu.data());
     }
   } else if (mode == "ccsds") {
+    // TODO: count packets without data
 
-    bool first_cadu = true;
-    int discarded_bytes = 0;
-    int discarded_cadus = 0;
-    bool discarded_bytes_reported = false;
-    while (std::cin >> cadu) {
-      // TODO: count fill packets
-      // TODO: count packets without data
-
-      if (first_cadu && cadu.first_header_pointer() != 0) {
-        // No valid bytes have been decoded yet
-        if (cadu.first_header_pointer() == std::pow(2, cadu::FIRST_HEADER_POINTER_LEN)-1) {
-          // This CADU contains no header. Skip
-          discarded_cadus++;
-        }
-        else {
-          // This CADU contains bytes before the first header
-          // Report any discarded bytes
-          discarded_bytes = cadu.first_header_pointer();
-          if (!discarded_bytes_reported) {
-            report_discarded_bytes(discarded_cadus, discarded_bytes);
-            discarded_bytes_reported = true;
-          }
-
-          // Output the remaining bytes
-          for (auto&& it : cadu.data_header_aligned()) {
-            std::cout << static_cast<const uint8_t>(it);
-          }
-          first_cadu = false;
-        }
-      } else {
-        // Report any discarded bytes
-        if (!discarded_bytes_reported) {
-          report_discarded_bytes(discarded_cadus, discarded_bytes);
-          discarded_bytes_reported = true;
-        }
-
-        for (auto&& it : cadu.data()) {
-          std::cout << static_cast<const uint8_t>(it);
-        }
-        first_cadu = false;
+    // Only whole packets are output, reassembled separately for each virtual channel
+    PacketReassembler packets;
+    while (reader >> cadu) {
+      if (cadu.is_fill()) {
+        fill_cadus++;
       }
+      packets.push(cadu, [&](int, std::span<std::byte const> packet) {
+        if (!drop_fill || cadu::packet_app_id(packet) != cadu::FILL_APP_ID) {
+          output.write(packet);
+        }
+      });
     }
 
-    // Report any remaining discarded bytes
-    if (!discarded_bytes_reported) {
-      report_discarded_bytes(discarded_cadus, discarded_bytes);
-      discarded_bytes_reported = true;  // May as well
+    auto const & stats = packets.statistics();
+    std::cerr << "Reassembled " << stats.packets << " packets, "
+              << stats.fill_packets << " fill" << (drop_fill ? " and dropped" : "") << '\n';
+    if (stats.repeats > 0) {
+      std::cerr << "Skipped " << stats.repeats << " CADUs repeating the VCDU counter of the one before" << '\n';
+    }
+    if (stats.gaps > 0 || stats.backward > 0 || stats.resyncs > 0) {
+      std::cerr << stats.gaps << " gaps in the VCDU counter lost " << stats.frames_lost << " CADUs, "
+                << "it stepped backwards " << stats.backward << " times, "
+                << stats.resyncs << " first header pointers disagreed with the packets before them, and "
+                << stats.packets_dropped << " partial packets were discarded" << '\n';
     }
-    
   } else {
     throw std::invalid_argument("Error: invalid mode: " + mode);
   }
+
+  try {
+    output.flush();
+  } catch (std::system_error const& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    exit(1);
+  }
+
+  if (drop_fill) {
+    std::cerr << "Dropped " << fill_cadus << " fill CADUs" << '\n';
+  }
 }
@@ -0,0 +1,117 @@
+// Measures ns/frame of the header work the tools do per frame: moving the
+// VCDU counter on and setting the first header pointer, as cadupack does, and
+// reading every field, as caduinfo does. Each is timed over cache-resident
+// frames for:
+// - bitfields: the packed bitfield layout libcadu used to keep the header in
+// - proxies: a CADU's per-field accessors
+// - header: a CADU's whole-header increment_vcdu_counter() and header()
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libcadu/libcadu.h"
+
+// The header as libcadu used to lay it out, with the same getters and setters
+struct Bitfields {
+  uint16_t _scid_h : cadu::SCID_LEN - 2 = 0;
+  uint16_t _version_number : cadu::VERSION_NUMBER_LEN = 0;
+  uint16_t _vcid : cadu::VCID_LEN = 0;
+  uint16_t _scid_l : 2 = 0;
+  uint32_t _vcdu_counter_h : 8 = 0;
+  uint32_t _vcdu_counter_m : 8 = 0;
+  uint32_t _vcdu_counter_l : 8 = 0;
+  uint32_t _vcdu_spare : cadu::VCDU_SPARE_LEN = 0;
+  uint32_t _replay_flag : cadu::REPLAY_FLAG_LEN = 0;
+  uint16_t _first_header_pointer_h : cadu::FIRST_HEADER_POINTER_LEN - 8 = 0;
+  uint16_t _m_pdu_spare : cadu::M_PDU_SPARE_LEN = 0;
+  uint16_t _first_header_pointer_l : 8 = 0;
+  bool dirty_checksum = true;
+
+  auto version_number() const -> int { return _version_number; }
+  auto scid() const -> int { return _scid_h << 2 | _scid_l; }
+  auto vcid() const -> int { return _vcid; }
+  auto vcdu_counter() const -> int { return _vcdu_counter_h << 16 | _vcdu_counter_m << 8 | _vcdu_counter_l; }
+  auto replay_flag() const -> int { return _replay_flag; }
+  auto vcdu_spare() const -> int { return _vcdu_spare; }
+  auto m_pdu_spare() const -> int { return _m_pdu_spare; }
+  auto first_header_pointer() const -> int { return _first_header_pointer_h << 8 | _first_header_pointer_l; }
+
+  void set_vcdu_counter(int x) {
+    _vcdu_counter_h = (x >> 16) & 0xff; _vcdu_counter_m = (x >> 8) & 0xff; _vcdu_counter_l = x & 0xff;
+    dirty_checksum = true;
+  }
+
+  void set_first_header_pointer(int x) {
+    _first_header_pointer_h = x >> 8; _first_header_pointer_l = x & 0xff;
+    dirty_checksum = true;
+  }
+};
+
+// Runs pass over every frame repeatedly for at least a second, returning ns/frame
+template <typename Frame, typename Pass>
+auto ns_per_frame(std::vector<Frame> & frames, Pass && pass) -> double {
+  using clock = std::chrono::steady_clock;
+  long sum = 0;
+  std::size_t done = 0;
+  auto start = clock::now();
+  auto elapsed = clock::duration::zero();
+  while (elapsed < std::chrono::seconds(1)) {
+    for (int rep = 0; rep < 1000; rep++) {
+      for (auto & frame : frames) {
+        sum += pass(frame, rep);
+      }
+    }
+    done += 1000 * frames.size();
+    elapsed = clock::now() - start;
+  }
+  // Keeps the work from being optimised away
+  [[maybe_unused]] volatile long result = sum;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / done;
+}
+
+int main(int argc, char *argv[]) {
+  int n = argc > 1 ? std::stoi(argv[1]) : 256;
+  constexpr int COUNTER_MASK = (1 << cadu::VCDU_COUNTER_LEN) - 1;
+
+  std::vector<Bitfields> bitfields(n);
+  std::vector<CADU> proxies(n);
+  std::vector<CADU> header(n);
+
+  auto bitfields_set = ns_per_frame(bitfields, [](Bitfields & frame, int rep) {
+    frame.set_vcdu_counter((frame.vcdu_counter() + 1) & COUNTER_MASK);
+    frame.set_first_header_pointer(rep & 0x7ff);
+    return 0;
+  });
+  auto proxies_set = ns_per_frame(proxies, [](CADU & frame, int rep) {
+    frame.vcdu_counter() = (frame.vcdu_counter() + 1) & COUNTER_MASK;
+    frame.first_header_pointer() = rep & 0x7ff;
+    return 0;
+  });
+  auto header_set = ns_per_frame(header, [](CADU & frame, int rep) {
+    frame.increment_vcdu_counter();
+    frame.first_header_pointer() = rep & 0x7ff;
+    return 0;
+  });
+
+  auto bitfields_get = ns_per_frame(bitfields, [](Bitfields const & frame, int) {
+    return frame.version_number() + frame.scid() + frame.vcid() + frame.vcdu_counter()
+         + frame.replay_flag() + frame.vcdu_spare() + frame.m_pdu_spare() + frame.first_header_pointer();
+  });
+  auto proxies_get = ns_per_frame(proxies, [](CADU const & frame, int) {
+    return frame.version_number() + frame.scid() + frame.vcid() + frame.vcdu_counter()
+         + frame.replay_flag() + frame.vcdu_spare() + frame.m_pdu_spare() + frame.first_header_pointer();
+  });
+  auto header_get = ns_per_frame(header, [](CADU const & frame, int) {
+    auto h = frame.header();
+    return h.version_number + h.scid + h.vcid + h.vcdu_counter
+         + h.replay_flag + h.vcdu_spare + h.m_pdu_spare + h.first_header_pointer;
+  });
+
+  std::cout << "access\tset ns/frame\tget ns/frame" << '\n'
+            << "bitfields\t" << bitfields_set << '\t' << bitfields_get << '\n'
+            << "proxies\t" << proxies_set << '\t' << proxies_get << '\n'
+            << "header\t" << header_set << '\t' << header_get << '\n';
+}
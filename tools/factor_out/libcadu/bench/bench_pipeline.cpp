@@ -0,0 +1,95 @@
+// Measures how checksum validation through a Pipeline scales with threads:
+// frames/s at 1, 2, 4... threads up to the cores available, and the speedup
+// over a single thread
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/pipeline.h"
+
+// Validates every frame repeatedly for at least a second, returning frames/s
+auto frames_per_second(std::vector<CADU> const & frames, unsigned threads) -> double {
+  using clock = std::chrono::steady_clock;
+  std::size_t valid = 0;
+  std::size_t validated = 0;
+
+  // As caduinfo --validate does, each frame is copied into a chunk alongside
+  // its result, validated on the pool, and counted in order
+  struct Checked {
+    CADU cadu;
+    bool valid;
+  };
+  Pipeline<Checked> pipeline(threads, [](std::span<Checked> chunk) {
+    for (auto & frame : chunk) {
+      frame.valid = frame.cadu._validate_checksum();
+    }
+  }, [&](std::span<Checked> chunk) {
+    for (auto const & frame : chunk) {
+      valid += frame.valid;
+    }
+  });
+
+  auto start = clock::now();
+  auto elapsed = clock::duration::zero();
+  while (elapsed < std::chrono::seconds(1)) {
+    for (auto const & cadu : frames) {
+      auto & chunk = pipeline.filling();
+      chunk.push_back({cadu, false});
+      if (chunk.size() == pipeline.chunk_size()) {
+        pipeline.submit();
+      }
+    }
+    pipeline.finish();
+    validated += frames.size();
+    elapsed = clock::now() - start;
+  }
+  // Keeps the work from being optimised away
+  [[maybe_unused]] volatile std::size_t result = valid;
+  return validated / std::chrono::duration<double>(elapsed).count();
+}
+
+int main(int argc, char *argv[]) {
+  int n = argc > 1 ? std::stoi(argv[1]) : 4096;
+  unsigned cores = argc > 2 ? std::stoul(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+  // Random frames, half of them with valid checksums
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<CADU> frames;
+  for (int i = 0; i < n; i++) {
+    std::array<std::uint8_t, sizeof(CVCDU)> received;
+    for (auto & b : received) {
+      b = byte(random);
+    }
+    CADU cadu(received.data());
+    if (i % 2 == 0) {
+      cadu.recalculate_checksum();
+    }
+    frames.push_back(cadu);
+  }
+
+  std::vector<unsigned> counts;
+  for (unsigned threads = 1; threads < cores; threads *= 2) {
+    counts.push_back(threads);
+  }
+  counts.push_back(cores);
+
+  std::cout << "threads\tframes/s\tspeedup" << '\n';
+  double single = 0;
+  for (auto threads : counts) {
+    auto rate = frames_per_second(frames, threads);
+    if (threads == 1) {
+      single = rate;
+    }
+    std::cout << threads << '\t' << static_cast<long>(rate) << '\t' << rate / single << '\n';
+  }
+}
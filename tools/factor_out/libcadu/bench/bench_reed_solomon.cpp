@@ -0,0 +1,79 @@
+// Measures frames/s of Reed-Solomon parity calculation by libfec, one
+// deinterleaved codeword at a time as libcadu used to, and by the native
+// encoder, over the same random CVCDUs
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "fec.h"
+}
+
+#include "libcadu/reed_solomon.h"
+
+using Data = std::array<std::byte, cadu::rs::INTERLEAVE * cadu::rs::DATA_SYMBOLS>;
+using Parity = std::array<std::byte, cadu::rs::INTERLEAVE * cadu::rs::PARITY_SYMBOLS>;
+
+void libfec_encode(Data const & data, Parity & parity) {
+  for (int c = 0; c < cadu::rs::INTERLEAVE; c++) {
+    std::array<unsigned char, cadu::rs::DATA_SYMBOLS> codeword;
+    std::array<unsigned char, cadu::rs::PARITY_SYMBOLS> codeword_parity;
+    for (int i = 0; i < cadu::rs::DATA_SYMBOLS; i++) {
+      codeword[i] = std::to_integer<unsigned char>(data[cadu::rs::INTERLEAVE * i + c]);
+    }
+    encode_rs_ccsds(codeword.data(), codeword_parity.data(), 0);
+    for (int k = 0; k < cadu::rs::PARITY_SYMBOLS; k++) {
+      parity[cadu::rs::INTERLEAVE * k + c] = std::byte{codeword_parity[k]};
+    }
+  }
+}
+
+void native_encode(Data const & data, Parity & parity) {
+  cadu::rs::encode(data, parity);
+}
+
+// Encodes every frame repeatedly for at least a second, returning frames/s
+template <typename Encode>
+auto frames_per_second(std::vector<Data> const & frames, Encode && encode) -> double {
+  using clock = std::chrono::steady_clock;
+  Parity parity;
+  std::uint8_t checksum = 0;
+  std::size_t encoded = 0;
+  auto start = clock::now();
+  auto elapsed = clock::duration::zero();
+  while (elapsed < std::chrono::seconds(1)) {
+    for (auto const & data : frames) {
+      encode(data, parity);
+      checksum ^= std::to_integer<std::uint8_t>(parity[0]);
+    }
+    encoded += frames.size();
+    elapsed = clock::now() - start;
+  }
+  // Keeps the work from being optimised away
+  [[maybe_unused]] volatile std::uint8_t result = checksum;
+  return encoded / std::chrono::duration<double>(elapsed).count();
+}
+
+int main(int argc, char *argv[]) {
+  int n = argc > 1 ? std::stoi(argv[1]) : 4096;
+
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<Data> frames(n);
+  for (auto & data : frames) {
+    for (auto & b : data) {
+      b = std::byte(byte(random));
+    }
+  }
+
+  auto libfec = frames_per_second(frames, libfec_encode);
+  auto native = frames_per_second(frames, native_encode);
+  std::cout << "libfec\t" << static_cast<long>(libfec) << " frames/s" << '\n'
+            << "native\t" << static_cast<long>(native) << " frames/s" << '\n'
+            << "speedup\t" << native / libfec << '\n';
+}
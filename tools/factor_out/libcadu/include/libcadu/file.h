@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libcadu/libcadu.h"
+
+// Read-only memory mapped view of a CADU capture on disk, giving random access
+// to frames without streaming through the whole file.
+//
+// On opening, the first and last sync markers are checked. If they show that
+// the capture is a contiguous sequence of CADUs, frame positions are computed
+// directly and no further pages are touched until a frame is accessed.
+// Otherwise (or when Scan::full is requested) the file is scanned once to build
+// a table of frame offsets.
+class CaduFile {
+public:
+  static constexpr std::size_t FRAME_LEN = sizeof(cadu::SYNC_MARKER) + sizeof(CVCDU);
+  using Frame = std::span<std::byte const, FRAME_LEN>;
+
+  enum class Scan { lazy, full };
+
+  explicit CaduFile(std::string const &path, Scan scan = Scan::lazy) {
+    map(path);
+    locate(scan);
+  }
+
+  // Maps an already open file descriptor, which remains owned by the caller
+  explicit CaduFile(int fd, Scan scan = Scan::lazy) {
+    map(fd);
+    locate(scan);
+  }
+
+  // Maps a capture whose frame offsets are already known, e.g. from a CaduIndex
+  CaduFile(std::string const &path, std::vector<std::uint64_t> frame_offsets)
+    : offsets{std::move(frame_offsets)} {
+    map(path);
+    if (!offsets.empty() && offsets.back() + FRAME_LEN > length) {
+      throw std::out_of_range("frame offsets extend beyond the end of the capture");
+    }
+    count = offsets.size();
+  }
+
+  CaduFile(CaduFile const &) = delete;
+  auto operator=(CaduFile const &) -> CaduFile & = delete;
+
+  ~CaduFile() {
+    if (mapping != MAP_FAILED && length > 0) {
+      ::munmap(mapping, length);
+    }
+  }
+
+  // Whether fd refers to something that can be mapped, rather than a pipe or terminal
+  static auto is_mappable(int fd) -> bool {
+    struct stat st;
+    return ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+  }
+
+  auto size() const -> std::size_t {
+    return count;
+  }
+
+  // Byte offset of the sync marker of frame i
+  auto offset(std::size_t i) const -> std::uint64_t {
+    return offsets.empty() ? base + i * FRAME_LEN : offsets[i];
+  }
+
+  // The whole of frame i, sync marker included, as it is laid out on disk
+  auto operator[](std::size_t i) const -> Frame {
+    return Frame{data() + offset(i), FRAME_LEN};
+  }
+
+  // Copies frame i out into a CADU
+  auto cadu(std::size_t i) const -> CADU {
+    return CADU(reinterpret_cast<uint8_t const *>((*this)[i].data() + sizeof(cadu::SYNC_MARKER)));
+  }
+
+  // Frames [first, first + n), clamped to the end of the file
+  auto frames(std::size_t first, std::size_t n) const {
+    first = std::min(first, count);
+    n = std::min(n, count - first);
+    return std::views::iota(first, first + n)
+      | std::views::transform([this](std::size_t i) { return (*this)[i]; });
+  }
+
+  // Advise the kernel of the expected access pattern
+  auto advise(int advice) const -> void {
+    if (length > 0) {
+      ::madvise(mapping, length, advice);
+    }
+  }
+
+private:
+  void *mapping = MAP_FAILED;
+  std::size_t length = 0;
+  std::size_t count = 0;
+  std::uint64_t base = 0;
+  std::vector<std::uint64_t> offsets;
+
+  auto data() const -> std::byte const * {
+    return static_cast<std::byte const *>(mapping);
+  }
+
+  auto has_sync(std::uint64_t offset) const -> bool {
+    return offset + FRAME_LEN <= length
+      && std::memcmp(data() + offset, cadu::SYNC_MARKER_BYTES.data(), cadu::SYNC_MARKER_BYTES.size()) == 0;
+  }
+
+  void map(std::string const &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "could not open " + path);
+    }
+    try {
+      map(fd);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+  }
+
+  void map(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      throw std::system_error(errno, std::generic_category(), "could not stat capture");
+    }
+    length = st.st_size;
+    if (length == 0) {
+      return;
+    }
+
+    mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "could not map capture");
+    }
+  }
+
+  void locate(Scan scan) {
+    // Find the first frame
+    base = 0;
+    while (base + FRAME_LEN <= length && !has_sync(base)) {
+      base++;
+    }
+    if (base + FRAME_LEN > length) {
+      return;
+    }
+
+    auto stride_count = (length - base) / FRAME_LEN;
+    if (scan == Scan::lazy && (length - base) % FRAME_LEN == 0
+        && has_sync(base + (stride_count - 1) * FRAME_LEN)) {
+      count = stride_count;
+      return;
+    }
+
+    build_offsets();
+  }
+
+  void build_offsets() {
+    advise(MADV_SEQUENTIAL);
+    offsets.reserve((length - base) / FRAME_LEN);
+    for (auto pos = base; pos + FRAME_LEN <= length;) {
+      if (has_sync(pos)) {
+        offsets.push_back(pos);
+        pos += FRAME_LEN;
+      } else {
+        pos++;
+      }
+    }
+    count = offsets.size();
+    advise(MADV_NORMAL);
+  }
+};
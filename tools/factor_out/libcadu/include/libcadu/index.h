@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/file.h"
+
+// Sidecar index of a CADU capture, stored alongside it as <capture>.caduidx
+//
+// The index records where each frame starts and the header fields most often
+// used to select frames, so a capture can be reopened without rescanning it.
+// It is tied to the size and modification time of the capture, and is treated
+// as absent once either changes.
+//
+// Layout (native byte order):
+//   CaduIndexHeader
+//   CaduIndexEntry[count]
+
+#pragma pack(push, 1)
+struct CaduIndexHeader {
+  std::array<char, 8> magic = {'C', 'A', 'D', 'U', 'I', 'D', 'X', '\0'};
+  uint32_t version = 1;
+  uint32_t entry_size = 0;
+  uint64_t file_size = 0;
+  int64_t mtime_sec = 0;
+  int64_t mtime_nsec = 0;
+  uint64_t count = 0;
+};
+
+struct CaduIndexEntry {
+  uint64_t offset;
+  uint32_t vcdu_counter;
+  uint16_t first_header_pointer;
+  uint8_t scid;
+  uint8_t vcid;
+};
+#pragma pack(pop)
+static_assert(sizeof(CaduIndexEntry) == 16,
+              "CaduIndexEntry is not of size 16");
+
+class CaduIndex {
+public:
+  static auto path_for(std::string const &capture) -> std::string {
+    return capture + ".caduidx";
+  }
+
+  // Scans a capture and records every frame in it
+  static auto build(std::string const &capture) -> CaduIndex {
+    CaduIndex index;
+    index.header = stamp(capture);
+
+    CaduFile file(capture, CaduFile::Scan::full);
+    file.advise(MADV_SEQUENTIAL);
+    index.entries.reserve(file.size());
+    for (std::size_t i = 0; i < file.size(); i++) {
+      // Only the header is read, rather than copying out the whole frame
+      auto header = VcduHeader::decode(file[i].subspan(sizeof(cadu::SYNC_MARKER)));
+      index.entries.push_back({
+        .offset = file.offset(i),
+        .vcdu_counter = static_cast<uint32_t>(header.vcdu_counter),
+        .first_header_pointer = static_cast<uint16_t>(header.first_header_pointer),
+        .scid = static_cast<uint8_t>(header.scid),
+        .vcid = static_cast<uint8_t>(header.vcid),
+      });
+    }
+    index.header.count = index.entries.size();
+    return index;
+  }
+
+  // Loads the sidecar index of a capture, if there is one and it is still valid
+  static auto load(std::string const &capture) -> std::optional<CaduIndex> {
+    CaduIndexHeader expected;
+    try {
+      expected = stamp(capture);
+    } catch (std::system_error const &) {
+      return std::nullopt;
+    }
+
+    std::ifstream input(path_for(capture), std::ios::binary);
+    CaduIndex index;
+    if (!input.read(reinterpret_cast<char *>(&index.header), sizeof(index.header))) {
+      return std::nullopt;
+    }
+
+    if (index.header.magic != expected.magic
+        || index.header.version != expected.version
+        || index.header.entry_size != expected.entry_size
+        || index.header.file_size != expected.file_size
+        || index.header.mtime_sec != expected.mtime_sec
+        || index.header.mtime_nsec != expected.mtime_nsec
+        || index.header.count > expected.file_size / CaduFile::FRAME_LEN) {
+      return std::nullopt;
+    }
+
+    index.entries.resize(index.header.count);
+    if (!input.read(reinterpret_cast<char *>(index.entries.data()), index.entries.size() * sizeof(CaduIndexEntry))) {
+      return std::nullopt;
+    }
+
+    // Frames follow one another through the capture without overlapping, so
+    // offsets that do not cannot be of this capture, whatever the header says
+    for (std::size_t i = 1; i < index.entries.size(); i++) {
+      std::uint64_t previous = index.entries[i - 1].offset;
+      std::uint64_t offset = index.entries[i].offset;
+      if (offset <= previous || offset - previous < CaduFile::FRAME_LEN) {
+        return std::nullopt;
+      }
+    }
+    if (!index.entries.empty() && index.entries.back().offset > index.header.file_size - CaduFile::FRAME_LEN) {
+      return std::nullopt;
+    }
+    return index;
+  }
+
+  void save(std::string const &capture) const {
+    auto path = path_for(capture);
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    output.write(reinterpret_cast<char const *>(entries.data()), entries.size() * sizeof(CaduIndexEntry));
+    if (!output.flush()) {
+      throw std::system_error(errno, std::generic_category(), "could not write " + path);
+    }
+  }
+
+  auto size() const -> std::size_t {
+    return entries.size();
+  }
+
+  auto operator[](std::size_t i) const -> CaduIndexEntry const & {
+    return entries[i];
+  }
+
+  auto begin() const {
+    return entries.begin();
+  }
+
+  auto end() const {
+    return entries.end();
+  }
+
+  // Frame offsets, in the form CaduFile takes in place of scanning
+  auto offsets() const -> std::vector<std::uint64_t> {
+    std::vector<std::uint64_t> result;
+    result.reserve(entries.size());
+    for (auto const &entry : entries) {
+      result.push_back(entry.offset);
+    }
+    return result;
+  }
+
+private:
+  CaduIndexHeader header;
+  std::vector<CaduIndexEntry> entries;
+
+  // Header identifying the current state of a capture
+  static auto stamp(std::string const &capture) -> CaduIndexHeader {
+    struct stat st;
+    if (::stat(capture.c_str(), &st) != 0) {
+      throw std::system_error(errno, std::generic_category(), "could not stat " + capture);
+    }
+    CaduIndexHeader header;
+    header.entry_size = sizeof(CaduIndexEntry);
+    header.file_size = st.st_size;
+    header.mtime_sec = st.st_mtim.tv_sec;
+    header.mtime_nsec = st.st_mtim.tv_nsec;
+    return header;
+  }
+};
@@ -1,6 +1,9 @@
+#pragma once
+
 #include <algorithm>
 #include <array>
 #include <bitset>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -13,27 +16,27 @@
 #include <vector>
 #include <utility>
 
-extern "C" {
-#include "fec.h"
-}
+#include <unistd.h>
 
 #include "getsetproxy/proxy.h"
+#include "libcadu/reed_solomon.h"
 
 // TODO: move everything that's not the CADU into the CADU
 
 // TODO: ensure that any output CADUs don't have their first_header_pointer beyond the frame
 //  Maybe emit a warning in this case?
 
-// TODO: implement is_fill test on CADU
-// TODO: Precalculate array of uint8_ts of sync pulse middle sections - 8x3
-// As constexpr into a const buffer
-// Currently we rely on the bit pattern being synchronised already
-
 // TODO: test bit outputs
 // TODO: calculate the sync marker most significant bit version by byte shifting in constexpr
 namespace cadu {
   constexpr uint32_t SYNC_MARKER = 0x1acffc1d;
   constexpr uint32_t SYNC_MARKER_MSB = 0x1dfccf1a;
+  constexpr std::array<std::byte, 4> SYNC_MARKER_BYTES {
+    std::byte{(SYNC_MARKER >> 24) & 0xff},
+    std::byte{(SYNC_MARKER >> 16) & 0xff},
+    std::byte{(SYNC_MARKER >> 8) & 0xff},
+    std::byte{SYNC_MARKER & 0xff}
+  };
   constexpr int VERSION_NUMBER_LEN = 2;
   constexpr int SCID_LEN = 8;
   constexpr int VCID_LEN = 6;
@@ -43,13 +46,120 @@ namespace cadu {
   constexpr int M_PDU_SPARE_LEN = 5;
   constexpr int FIRST_HEADER_POINTER_LEN = 11;
   constexpr int DATA_LEN = 884;
+  // Virtual channel of fill frames, sent when there is nothing else to send
+  constexpr int FILL_VCID = (1 << VCID_LEN) - 1;
+
+  // The VCDU primary header and M_PDU header, which come before the data
+  constexpr std::size_t HEADER_LEN = 8;
+
+  // A field of the header, by where it sits in the header read as one
+  // big-endian 64 bit word, so it can be read or written with a shift and mask
+  struct HeaderField {
+    int shift;
+    int len;
+
+    constexpr auto mask() const -> uint64_t {
+      return ((uint64_t{1} << len) - 1) << shift;
+    }
+
+    constexpr auto get(uint64_t header) const -> int {
+      return static_cast<int>((header & mask()) >> shift);
+    }
+
+    // Values too wide for the field are truncated to fit
+    constexpr auto set(uint64_t header, int value) const -> uint64_t {
+      return (header & ~mask()) | ((static_cast<uint64_t>(value) << shift) & mask());
+    }
+  };
+
+  // In order from the most significant bit of the header
+  namespace field {
+    constexpr HeaderField VERSION_NUMBER {64 - VERSION_NUMBER_LEN, VERSION_NUMBER_LEN};
+    constexpr HeaderField SCID {VERSION_NUMBER.shift - SCID_LEN, SCID_LEN};
+    constexpr HeaderField VCID {SCID.shift - VCID_LEN, VCID_LEN};
+    constexpr HeaderField VCDU_COUNTER {VCID.shift - VCDU_COUNTER_LEN, VCDU_COUNTER_LEN};
+    constexpr HeaderField REPLAY_FLAG {VCDU_COUNTER.shift - REPLAY_FLAG_LEN, REPLAY_FLAG_LEN};
+    constexpr HeaderField VCDU_SPARE {REPLAY_FLAG.shift - VCDU_SPARE_LEN, VCDU_SPARE_LEN};
+    constexpr HeaderField M_PDU_SPARE {VCDU_SPARE.shift - M_PDU_SPARE_LEN, M_PDU_SPARE_LEN};
+    constexpr HeaderField FIRST_HEADER_POINTER {M_PDU_SPARE.shift - FIRST_HEADER_POINTER_LEN, FIRST_HEADER_POINTER_LEN};
+    static_assert(FIRST_HEADER_POINTER.shift == 0, "Header fields do not fill the header");
+  }
+
+  // Spelled out byte by byte, which compilers turn into a single load or store
+  // and a byte swap
+  constexpr auto load_header(std::span<std::byte const, HEADER_LEN> bytes) -> uint64_t {
+    auto byte = [&](std::size_t i) { return std::to_integer<uint64_t>(bytes[i]); };
+    return byte(0) << 56 | byte(1) << 48 | byte(2) << 40 | byte(3) << 32
+         | byte(4) << 24 | byte(5) << 16 | byte(6) << 8 | byte(7);
+  }
+
+  constexpr void store_header(uint64_t header, std::span<std::byte, HEADER_LEN> bytes) {
+    bytes[0] = std::byte(header >> 56);
+    bytes[1] = std::byte(header >> 48);
+    bytes[2] = std::byte(header >> 40);
+    bytes[3] = std::byte(header >> 32);
+    bytes[4] = std::byte(header >> 24);
+    bytes[5] = std::byte(header >> 16);
+    bytes[6] = std::byte(header >> 8);
+    bytes[7] = std::byte(header);
+  }
 }
 
+// The fields of a header, decoded together
+struct VcduHeader {
+  int version_number = 0;
+  int scid = 0;
+  int vcid = 0;
+  int vcdu_counter = 0;
+  int replay_flag = 0;
+  int vcdu_spare = 0;
+  int m_pdu_spare = 0;
+  int first_header_pointer = 0;
+
+  static constexpr auto decode(uint64_t header) -> VcduHeader {
+    using namespace cadu::field;
+    return {
+      .version_number = VERSION_NUMBER.get(header),
+      .scid = SCID.get(header),
+      .vcid = VCID.get(header),
+      .vcdu_counter = VCDU_COUNTER.get(header),
+      .replay_flag = REPLAY_FLAG.get(header),
+      .vcdu_spare = VCDU_SPARE.get(header),
+      .m_pdu_spare = M_PDU_SPARE.get(header),
+      .first_header_pointer = FIRST_HEADER_POINTER.get(header),
+    };
+  }
+
+  // Decodes the header at the start of a CVCDU, as it follows the sync marker,
+  // for when only the headers are wanted and copying each frame into a CADU
+  // would be wasted
+  static constexpr auto decode(std::span<std::byte const> cvcdu) -> VcduHeader {
+    return decode(cadu::load_header(cvcdu.first<cadu::HEADER_LEN>()));
+  }
+
+  // Values too wide for their fields are truncated to fit
+  constexpr auto encode() const -> uint64_t {
+    using namespace cadu::field;
+    uint64_t header = 0;
+    header = VERSION_NUMBER.set(header, version_number);
+    header = SCID.set(header, scid);
+    header = VCID.set(header, vcid);
+    header = VCDU_COUNTER.set(header, vcdu_counter);
+    header = REPLAY_FLAG.set(header, replay_flag);
+    header = VCDU_SPARE.set(header, vcdu_spare);
+    header = M_PDU_SPARE.set(header, m_pdu_spare);
+    header = FIRST_HEADER_POINTER.set(header, first_header_pointer);
+    return header;
+  }
+};
+static_assert(VcduHeader::decode(0x4ec7123456808fffull).encode() == 0x4ec7123456808fffull);
+static_assert(VcduHeader::decode(0x5a9e00000100801full).scid == 0x6a);
+
 // Default encoding table, from generator polynomial x**8 + x**7 + x**5 + x**3 + 1
 // From gov/nasa/gsfc/drl/rtstps/core/PnDecoder.java, originally from
 // Gerald Grebowsky of GSFC in 1996
 
-const uint8_t randomise_table[] = {
+constexpr uint8_t randomise_table[] = {
     0xff, 0x48, 0x0e, 0xc0, 0x9a, 0x0d, 0x70, 0xbc, 0x8e, 0x2c, 0x93,
     0xad, 0xa7, 0xb7, 0x46, 0xce, 0x5a, 0x97, 0x7d, 0xcc, 0x32, 0xa2,
     0xbf, 0x3e, 0x0a, 0x10, 0xf1, 0x88, 0x94, 0xcd, 0xea, 0xb1, 0xfe,
@@ -79,22 +189,13 @@ const uint8_t randomise_table[] = {
 
 // TODO: methods to allow the insertion of spans into the data
 
+// The header is kept as the bytes it is sent as, and its fields are read and
+// written through cadu::field, so their layout doesn't depend on the compiler
 #pragma pack(push, 1)
 struct VC_PDU {
   friend class CADU;
 private:
-  uint16_t _scid_h : cadu::SCID_LEN - 2 = 0;
-  uint16_t _version_number : cadu::VERSION_NUMBER_LEN = 0;
-  uint16_t _vcid : cadu::VCID_LEN = 0;
-  uint16_t _scid_l : 2 = 0;
-  uint32_t _vcdu_counter_h : 8 = 0;
-  uint32_t _vcdu_counter_m : 8 = 0;
-  uint32_t _vcdu_counter_l : 8 = 0;
-  uint32_t _vcdu_spare : cadu::VCDU_SPARE_LEN = 0;
-  uint32_t _replay_flag : cadu::REPLAY_FLAG_LEN = 0;
-  uint16_t _first_header_pointer_h : cadu::FIRST_HEADER_POINTER_LEN - 8 = 0;
-  uint16_t _m_pdu_spare : cadu::M_PDU_SPARE_LEN = 0;
-  uint16_t _first_header_pointer_l : 8 = 0;
+  std::array<std::byte, cadu::HEADER_LEN> _header = {};
   std::array<std::byte, cadu::DATA_LEN> _data = {};
 };
 #pragma pack(pop)
@@ -109,7 +210,7 @@ struct CVCDU {
   friend class CADU;
 private:
   VC_PDU vc_pdu;
-  mutable std::array<std::byte, 128> _checksum;
+  std::array<std::byte, 128> _checksum;
 
 public:
   CVCDU() = default;
@@ -123,16 +224,68 @@ static_assert(std::is_trivially_copyable_v<CVCDU>,
 static_assert(std::is_standard_layout_v<CVCDU>,
               "CVCDU is not a standard layout type");
 
+namespace cadu {
+  // The randomisation sequence expanded over a whole CVCDU, so that it can be
+  // applied a word at a time rather than indexing randomise_table modulo its length
+  // Generated from the same polynomial, starting from all ones as in sec 10.4.1
+  // https://public.ccsds.org/Pubs/131x0b3e1.pdf
+  constexpr auto make_randomise_sequence() -> std::array<uint8_t, sizeof(CVCDU)> {
+    std::array<uint8_t, sizeof(CVCDU)> sequence {};
+    // The register holds the next 8 output bits, oldest in the most significant bit
+    uint8_t state = 0xff;
+    for (auto & byte : sequence) {
+      for (int bit = 0; bit < 8; bit++) {
+        auto output = state >> 7;
+        auto feedback = (state >> 7) ^ (state >> 4) ^ (state >> 2) ^ state;
+        byte = byte << 1 | output;
+        state = state << 1 | (feedback & 1);
+      }
+    }
+    return sequence;
+  }
+
+  alignas(64) constexpr auto RANDOMISE_SEQUENCE = make_randomise_sequence();
+
+  static_assert(std::ranges::equal(std::span(RANDOMISE_SEQUENCE).first<sizeof(randomise_table)>(), randomise_table),
+                "Generated randomisation sequence does not match randomise_table");
+
+  // XORs a CVCDU with the randomisation sequence, from input into output, which
+  // may be the same buffer
+  // Randomising and derandomising are the same operation
+  inline void randomise(std::span<std::byte const, sizeof(CVCDU)> input, std::span<std::byte, sizeof(CVCDU)> output) {
+    constexpr auto word_bytes = sizeof(CVCDU) - sizeof(CVCDU) % sizeof(uint64_t);
+    // memcpy keeps the word accesses free of alignment and aliasing problems,
+    // and compiles down to plain (vectorisable) loads and stores
+    for (std::size_t i = 0; i < word_bytes; i += sizeof(uint64_t)) {
+      uint64_t word, key;
+      std::memcpy(&word, input.data() + i, sizeof(word));
+      std::memcpy(&key, RANDOMISE_SEQUENCE.data() + i, sizeof(key));
+      word ^= key;
+      std::memcpy(output.data() + i, &word, sizeof(word));
+    }
+    for (auto i = word_bytes; i < sizeof(CVCDU); i++) {
+      output[i] = input[i] ^ std::byte{RANDOMISE_SEQUENCE[i]};
+    }
+  }
+
+  inline void randomise(std::span<std::byte, sizeof(CVCDU)> frame) {
+    randomise(frame, frame);
+  }
+}
+
 struct CADU;
+class CaduReader;
 
 namespace nonrandomised {
   auto operator<<(std::ostream & output, CADU const & cadu) -> std::ostream &;
   auto operator>>(std::istream & input, CADU & cadu) -> std::istream &;
+  auto operator>>(CaduReader & input, CADU & cadu) -> CaduReader &;
 }
 
 namespace randomised {
   auto operator<<(std::ostream & output, CADU const & cadu) -> std::ostream &;
   auto operator>>(std::istream & input, CADU & cadu) -> std::istream &;
+  auto operator>>(CaduReader & input, CADU & cadu) -> CaduReader &;
 }
 
 struct CADU {
@@ -143,176 +296,136 @@ private:
 
     Impl() = default;
     Impl(VC_PDU const &vc_pdu) : cvcdu{vc_pdu} {}
+    Impl(CVCDU const &cvcdu) : cvcdu{cvcdu} {}
   };
 
   Impl impl;
-  mutable bool dirty_checksum = true; // Even the empty CADU needs to have its checksum calculated
+  bool dirty_checksum = true; // Even the empty CADU needs to have its checksum calculated
 
   auto randomise() -> void {
-    auto data = reinterpret_cast<uint8_t*>(&impl.cvcdu);
-    for (int i = 0; i < sizeof(impl.cvcdu); i++) {
-      data[i] ^= randomise_table[i%sizeof(randomise_table)];
-    }
+    cadu::randomise(std::span<std::byte, sizeof(CVCDU)>(reinterpret_cast<std::byte*>(&impl.cvcdu), sizeof(CVCDU)));
   }
 
 public:
   // Constructor for everything without sync pulse
   CADU() = default;
-  CADU(const CADU &cadu) : impl{cadu.impl.cvcdu.vc_pdu}, dirty_checksum{cadu.dirty_checksum} {}
-  CADU(uint8_t const *const input) {std::memcpy(&impl.cvcdu, input, sizeof(CVCDU));}
+  CADU(const CADU &cadu) : impl{cadu.impl.cvcdu}, dirty_checksum{cadu.dirty_checksum} {}
+  // Copies a whole received CVCDU, so its checksum is taken as it was received
+  CADU(uint8_t const *const input) : dirty_checksum{false} {std::memcpy(&impl.cvcdu, input, sizeof(CVCDU));}
 
   CADU(VC_PDU const &vc_pdu) : impl{vc_pdu}, dirty_checksum{true} {}
 
 private:
-  void calculate_checksum(std::array<std::byte, 128>& checksum) const {
-    // Deinterleave the blocks to depth 4
+  void calculate_checksum(std::span<std::byte, 128> checksum) const {
+    // The blocks are interleaved to depth 4
     // Described in sec 4.4.1 https://public.ccsds.org/Pubs/131x0b3e1.pdf
-    auto data0 = std::array<unsigned char, 223> {};
-    auto data1 = std::array<unsigned char, 223> {};
-    auto data2 = std::array<unsigned char, 223> {};
-    auto data3 = std::array<unsigned char, 223> {};
-
-    static_assert(sizeof(impl.cvcdu.vc_pdu) == 4*223, "VC_PDU wrong size");
-    auto buffer = reinterpret_cast<const unsigned char*>(&impl.cvcdu.vc_pdu);
-    for (int i=222; i>-1; i--) {
-      data0[i] = buffer[4*i];
-      data1[i] = buffer[4*i+1];
-      data2[i] = buffer[4*i+2];
-      data3[i] = buffer[4*i+3];
-    }
+    static_assert(sizeof(impl.cvcdu.vc_pdu) == cadu::rs::INTERLEAVE * cadu::rs::DATA_SYMBOLS, "VC_PDU wrong size");
+    auto buffer = std::span<std::byte const, sizeof(VC_PDU)>(reinterpret_cast<const std::byte*>(&impl.cvcdu.vc_pdu), sizeof(VC_PDU));
+    cadu::rs::encode(buffer, checksum);
+  }
 
-    auto parity0 = std::array<unsigned char, 32> {};
-    auto parity1 = std::array<unsigned char, 32> {};
-    auto parity2 = std::array<unsigned char, 32> {};
-    auto parity3 = std::array<unsigned char, 32> {};
-
-    encode_rs_ccsds(data0.data(), parity0.data(), 0);
-    encode_rs_ccsds(data1.data(), parity1.data(), 0);
-    encode_rs_ccsds(data2.data(), parity2.data(), 0);
-    encode_rs_ccsds(data3.data(), parity3.data(), 0);
-
-    for (int i=0; i<32; i++) {
-      checksum[4*i] = std::byte(parity0[i]);
-      checksum[4*i+1] = std::byte(parity1[i]);
-      checksum[4*i+2] = std::byte(parity2[i]);
-      checksum[4*i+3] = std::byte(parity3[i]);
-    }
+  auto header_word() const -> uint64_t {
+    return cadu::load_header(impl.cvcdu.vc_pdu._header);
+  }
+
+  void set_header_word(uint64_t header) {
+    cadu::store_header(header, impl.cvcdu.vc_pdu._header);
+    dirty_checksum = true;
+  }
+
+  auto get(cadu::HeaderField field) const -> int {
+    return field.get(header_word());
+  }
+
+  auto field(cadu::HeaderField field) & {
+    return Proxy{
+      [this, field]() -> int { return get(field); },
+      [this, field](int x) { set_header_word(field.set(header_word(), x)); }
+    };
   }
 
 public:
   auto version_number() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._version_number);
+    return get(cadu::field::VERSION_NUMBER);
   }
 
   auto version_number() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).version_number(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._version_number = x;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::VERSION_NUMBER);
   }
 
   auto scid() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._scid_h << 2 | impl.cvcdu.vc_pdu._scid_l);
+    return get(cadu::field::SCID);
   }
 
   auto scid() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).scid(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._scid_h = (x >> 2) & 0xff;
-        impl.cvcdu.vc_pdu._scid_l = x & 0x03;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::SCID);
   }
 
   auto vcid() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._vcid);
+    return get(cadu::field::VCID);
   }
 
   auto vcid() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).vcid(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._vcid = x;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::VCID);
+  }
+
+  auto is_fill() const -> bool {
+    return vcid() == cadu::FILL_VCID;
   }
 
   auto vcdu_counter() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._vcdu_counter_h << 16 | impl.cvcdu.vc_pdu._vcdu_counter_m << 8 | impl.cvcdu.vc_pdu._vcdu_counter_l);
+    return get(cadu::field::VCDU_COUNTER);
   }
 
   auto vcdu_counter() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).vcdu_counter(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._vcdu_counter_h = (x >> 16) & 0xff;
-        impl.cvcdu.vc_pdu._vcdu_counter_m = (x >> 8) & 0xff;
-        impl.cvcdu.vc_pdu._vcdu_counter_l = x & 0xff;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::VCDU_COUNTER);
+  }
+
+  // Moves the VCDU counter on by one, wrapping around to 0 after its largest value
+  void increment_vcdu_counter() {
+    auto header = header_word();
+    set_header_word(cadu::field::VCDU_COUNTER.set(header, cadu::field::VCDU_COUNTER.get(header) + 1));
   }
 
   auto replay_flag() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._replay_flag);
+    return get(cadu::field::REPLAY_FLAG);
   }
 
   auto replay_flag() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).replay_flag(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._replay_flag = x;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::REPLAY_FLAG);
   }
 
   auto vcdu_spare() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._vcdu_spare);
+    return get(cadu::field::VCDU_SPARE);
   }
 
   auto vcdu_spare() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).vcdu_spare(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._vcdu_spare = x;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::VCDU_SPARE);
   }
 
   auto m_pdu_spare() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._m_pdu_spare);
+    return get(cadu::field::M_PDU_SPARE);
   }
 
   auto m_pdu_spare() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).m_pdu_spare(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._m_pdu_spare = x;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::M_PDU_SPARE);
   }
 
   auto first_header_pointer() const & {
-    return static_cast<int>(impl.cvcdu.vc_pdu._first_header_pointer_h << 8 | impl.cvcdu.vc_pdu._first_header_pointer_l);
+    return get(cadu::field::FIRST_HEADER_POINTER);
   }
 
   auto first_header_pointer() & {
-    return Proxy{
-      [this]() -> decltype(auto) { return std::as_const(*this).first_header_pointer(); },
-      [this](int x) {
-        impl.cvcdu.vc_pdu._first_header_pointer_h = x >> 8; impl.cvcdu.vc_pdu._first_header_pointer_l= x & 0xff;
-        dirty_checksum = true;
-      }
-    };
+    return field(cadu::field::FIRST_HEADER_POINTER);
+  }
+
+  // Every header field at once, for when more than one is wanted
+  auto header() const -> VcduHeader {
+    return VcduHeader::decode(header_word());
+  }
+
+  void set_header(VcduHeader const & header) {
+    set_header_word(header.encode());
   }
 
   auto data() const & -> auto const & {
@@ -329,6 +442,13 @@ public:
     };
   }
 
+  // The data field, for packing into in place rather than copying in a whole buffer
+  // The checksum is marked dirty, as the data is expected to be written through it
+  auto mutable_data() & -> std::span<std::byte, cadu::DATA_LEN> {
+    dirty_checksum = true;
+    return impl.cvcdu.vc_pdu._data;
+  }
+
   auto data_header_aligned() const & -> auto const {
     return std::views::counted(data().begin() + first_header_pointer(), cadu::DATA_LEN - (first_header_pointer()));
   }
@@ -352,6 +472,26 @@ public:
     return impl.cvcdu._checksum;
   }
 
+  // The frame as laid out in a nonrandomised stream, sync marker included
+  // The checksum within it is only up to date if the CADU's checksum isn't dirty
+  auto bytes() const & -> std::span<std::byte const, sizeof(Impl)> {
+    return std::span<std::byte const, sizeof(Impl)>(reinterpret_cast<std::byte const*>(&impl), sizeof(Impl));
+  }
+
+  // Copies out the frame as laid out in a nonrandomised stream, calculating
+  // the checksum if it is dirty
+  void copy_to(std::span<std::byte, sizeof(Impl)> output) const {
+    std::memcpy(output.data(), &impl, sizeof(Impl));
+    if (dirty_checksum) {
+      calculate_checksum(output.last<sizeof(impl.cvcdu._checksum)>());
+    }
+  }
+
+  // Whether the checksum is out of date with the rest of the frame
+  auto dirty() const -> bool {
+    return dirty_checksum;
+  }
+
   auto checksum() & {
     return Proxy{
       [this]() -> decltype(auto) { return std::as_const(*this).checksum(); },
@@ -359,19 +499,60 @@ public:
     };
   }
 
-  // TODO: place a lock on dirty_checksum and the checksum itself, as this isn't thread safe
-  // const methods are assumed thread safe, which this isn't, because the checksum and dirty
-  // bit are both mutable
-  // This method is only const because the stream insertion operator needed to be
-  // in order to use it 
-  void recalculate_checksum() const {
+  // Const methods never modify the CADU, so a CADU that is no longer being
+  // modified can be read and written out from several threads at once.
+  // Writing out a CADU with a dirty checksum calculates the checksum afresh
+  // each time, so recalculate it first if the CADU is written more than once.
+  void recalculate_checksum() {
     calculate_checksum(impl.cvcdu._checksum);
     dirty_checksum = false;
   }
 
+  // Recalculates the checksums of every dirty CADU in a batch
+  // Batches may be split between threads, as long as each CADU is only in one
+  static void recalculate_checksums(std::span<CADU> cadus) {
+    for (auto &cadu : cadus) {
+      if (cadu.dirty_checksum) {
+        cadu.recalculate_checksum();
+      }
+    }
+  }
+
+  // Corrects errors in the frame using its checksum, returning the number of
+  // symbols corrected in each of the four interleaved codewords, or -1 for
+  // codewords with too many errors to correct, which are left as they are.
+  // Frames that could not be corrected keep the checksum received.
+  //
+  // Only meaningful on frames as they were received. A frame changed since has
+  // a dirty checksum, which says nothing about its contents, so the checksum is
+  // recalculated instead and nothing is corrected.
+  auto correct() -> std::array<int, cadu::rs::INTERLEAVE> {
+    if (dirty_checksum) {
+      recalculate_checksum();
+      return {};
+    }
+    auto data = std::span<std::byte, sizeof(VC_PDU)>(reinterpret_cast<std::byte*>(&impl.cvcdu.vc_pdu), sizeof(VC_PDU));
+    return cadu::rs::decode(data, impl.cvcdu._checksum);
+  }
+
+  // Corrects every CADU in a batch, storing the result of correct() for each
+  // Batches may be split between threads, as long as each CADU is only in one
+  static void correct_all(std::span<CADU> cadus, std::span<std::array<int, cadu::rs::INTERLEAVE>> corrected) {
+    for (std::size_t i = 0; i < cadus.size(); i++) {
+      corrected[i] = cadus[i].correct();
+    }
+  }
+
+  // Randomises (or derandomises) every CADU in a batch in place
+  // Batches may be split between threads, as long as each CADU is only in one
+  static void randomise_all(std::span<CADU> cadus) {
+    for (auto &cadu : cadus) {
+      cadu.randomise();
+    }
+  }
+
   // TODO: replace with method which attempts to calculate where the errors are
-  // TODO: implement method to correct bit errors given the checksum
-  auto _validate_checksum() -> bool {
+  auto _validate_checksum() const -> bool {
     if (dirty_checksum) {
       return false;
     } else {
@@ -386,9 +567,110 @@ public:
   friend auto nonrandomised::operator>>(std::istream & input, ::CADU & cadu) -> std::istream &;
   friend auto randomised::operator<<(std::ostream & output, ::CADU const & cadu) -> std::ostream &;
   friend auto randomised::operator>>(std::istream & input, ::CADU & cadu) -> std::istream &;
+  friend auto nonrandomised::operator>>(CaduReader & input, ::CADU & cadu) -> CaduReader &;
+  friend auto randomised::operator>>(CaduReader & input, ::CADU & cadu) -> CaduReader &;
 
 };
 
+// Reads CADUs from a file descriptor or streambuf in large blocks, searching for
+// the sync marker within the block rather than pulling one byte at a time.
+// Frames are handed out as views into the internal buffer, so reading a frame
+// performs no allocation.
+class CaduReader {
+public:
+  static constexpr std::size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+  using Frame = std::span<std::byte const, sizeof(CVCDU)>;
+
+  explicit CaduReader(int fd, std::size_t block_size = DEFAULT_BLOCK_SIZE)
+    : fd{fd}, buffer(std::max(block_size, 2 * FRAME_LEN)) {}
+
+  explicit CaduReader(std::streambuf *source, std::size_t block_size = DEFAULT_BLOCK_SIZE)
+    : source{source}, buffer(std::max(block_size, 2 * FRAME_LEN)) {}
+
+  // Returns the contents of the next frame following a sync marker, or nothing
+  // at the end of the stream. The view is only valid until the next call.
+  auto next() -> std::optional<Frame> {
+    while (true) {
+      auto match = find_sync();
+      if (match && tail - *match >= FRAME_LEN) {
+        frame_offset = buffer_offset + *match;
+        head = *match + FRAME_LEN;
+        good = true;
+        return Frame{buffer.data() + *match + sizeof(cadu::SYNC_MARKER), sizeof(CVCDU)};
+      }
+
+      // Keep any partial sync marker or partial frame, and read more
+      head = match.value_or(tail - std::min<std::size_t>(tail - head, sizeof(cadu::SYNC_MARKER) - 1));
+      if (!fill()) {
+        good = false;
+        return std::nullopt;
+      }
+    }
+  }
+
+  // Byte offset within the stream of the sync marker of the last frame read
+  auto offset() const -> std::uint64_t {
+    return frame_offset;
+  }
+
+  explicit operator bool() const {
+    return good;
+  }
+
+private:
+  static constexpr std::size_t FRAME_LEN = sizeof(cadu::SYNC_MARKER) + sizeof(CVCDU);
+  int fd = -1;
+  std::streambuf *source = nullptr;
+  std::vector<std::byte> buffer;
+  std::size_t head = 0;
+  std::size_t tail = 0;
+  std::uint64_t buffer_offset = 0; // Stream offset of buffer[0]
+  std::uint64_t frame_offset = 0;
+  bool good = true;
+
+  // Searches the unconsumed part of the buffer for a whole sync marker
+  auto find_sync() const -> std::optional<std::size_t> {
+    auto data = buffer.data();
+    // In an aligned stream the next frame follows on directly
+    if (tail - head >= cadu::SYNC_MARKER_BYTES.size() && std::memcmp(data + head, cadu::SYNC_MARKER_BYTES.data(), cadu::SYNC_MARKER_BYTES.size()) == 0) {
+      return head;
+    }
+
+    auto it = std::search(data + head, data + tail, cadu::SYNC_MARKER_BYTES.begin(), cadu::SYNC_MARKER_BYTES.end());
+    if (it == data + tail) {
+      return std::nullopt;
+    }
+    return it - data;
+  }
+
+  // Moves the unconsumed bytes to the front of the buffer and reads another block
+  auto fill() -> bool {
+    if (head > 0) {
+      std::memmove(buffer.data(), buffer.data() + head, tail - head);
+      buffer_offset += head;
+      tail -= head;
+      head = 0;
+    }
+
+    auto space = buffer.size() - tail;
+    auto destination = buffer.data() + tail;
+    ssize_t n;
+    if (source) {
+      n = source->sgetn(reinterpret_cast<char*>(destination), space);
+    } else {
+      do {
+        n = ::read(fd, destination, space);
+      } while (n < 0 && errno == EINTR);
+    }
+
+    if (n <= 0) {
+      return false;
+    }
+    tail += n;
+    return true;
+  }
+};
+
 namespace nonrandomised {
   struct _CADU: ::CADU {
     _CADU () = default;
@@ -397,10 +679,14 @@ namespace nonrandomised {
 
   auto operator<<(std::ostream & output, ::CADU const & cadu) -> std::ostream & {
     if (cadu.dirty_checksum) {
-      std::cerr << "dirty checksum. recalculating..." << std::endl;
-      cadu.recalculate_checksum();
+      // The checksum is last, so can be written separately
+      auto checksum = std::array<std::byte, 128> {};
+      cadu.calculate_checksum(checksum);
+      output.write(reinterpret_cast<const char*>(&cadu.impl), sizeof(cadu.impl) - checksum.size());
+      output.write(reinterpret_cast<const char*>(checksum.data()), checksum.size());
+    } else {
+      output.write(reinterpret_cast<const char*>(&cadu.impl), sizeof(cadu.impl));
     }
-    output.write(reinterpret_cast<const char*>(&cadu.impl), sizeof(cadu.impl));
     return output;
   }
 
@@ -408,10 +694,12 @@ namespace nonrandomised {
     uint32_t prefix_buffer = 0;
     bool found_header = false;
 
-    for (uint8_t byte_buffer; input >> byte_buffer;) {
+    // Unformatted extraction, as whitespace bytes are valid data
+    auto source = input.rdbuf();
+    for (auto byte_buffer = source->sbumpc(); byte_buffer != std::char_traits<char>::eof(); byte_buffer = source->sbumpc()) {
       // Update prefix buffer
       prefix_buffer <<= 8;
-      prefix_buffer |= byte_buffer;
+      prefix_buffer |= static_cast<uint8_t>(byte_buffer);
 
       // Check for matching prefix
       if (prefix_buffer == cadu::SYNC_MARKER) {
@@ -422,13 +710,23 @@ namespace nonrandomised {
 
     if (found_header) {
       // We found the next frame
-      // TODO: bytes on the stack instead
-      auto bytes = std::make_unique_for_overwrite<char[]>(sizeof(CVCDU)/sizeof(char));
-      input.read(bytes.get(), sizeof(CVCDU));
-      std::memcpy(&cadu.impl.cvcdu, bytes.get(), sizeof(CVCDU));
+      // A frame read whole keeps the checksum it was received with, until it is modified
+      if (input.read(reinterpret_cast<char*>(&cadu.impl.cvcdu), sizeof(CVCDU))) {
+        cadu.dirty_checksum = false;
+      }
+    } else {
+      input.setstate(std::ios::eofbit | std::ios::failbit);
     }
     return input;
-  }  
+  }
+
+  auto operator>>(CaduReader & input, ::CADU & cadu) -> CaduReader & {
+    if (auto frame = input.next()) {
+      std::memcpy(&cadu.impl.cvcdu, frame->data(), sizeof(CVCDU));
+      cadu.dirty_checksum = false;
+    }
+    return input;
+  }
 }
 
 namespace randomised {
@@ -438,9 +736,21 @@ namespace randomised {
   };
 
   auto operator<<(std::ostream & output, ::CADU const & cadu) -> std::ostream & {
-    auto randomised_cadu = ::CADU(cadu);
-    randomised_cadu.randomise();
-    nonrandomised::operator<<(output, randomised_cadu);
+    alignas(8) std::array<std::byte, sizeof(cadu.impl)> buffer;
+    auto frame = cadu.bytes();
+    std::copy_n(frame.begin(), sizeof(cadu.impl.sync), buffer.begin());
+    cadu::randomise(frame.last<sizeof(CVCDU)>(), std::span(buffer).last<sizeof(CVCDU)>());
+    if (cadu.dirty_checksum) {
+      // The checksum covers the nonrandomised frame, so is calculated separately
+      // and randomised in place of the stale one
+      auto checksum = std::array<std::byte, 128> {};
+      cadu.calculate_checksum(checksum);
+      auto offset = sizeof(CVCDU) - checksum.size();
+      for (std::size_t i = 0; i < checksum.size(); i++) {
+        buffer[sizeof(cadu.impl.sync) + offset + i] = checksum[i] ^ std::byte{cadu::RANDOMISE_SEQUENCE[offset + i]};
+      }
+    }
+    output.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
     return output;
   }
 
@@ -449,6 +759,13 @@ namespace randomised {
     cadu.randomise();
     return input;
   }
+
+  auto operator>>(CaduReader & input, ::CADU & cadu) -> CaduReader & {
+    if (nonrandomised::operator>>(input, cadu)) {
+      cadu.randomise();
+    }
+    return input;
+  }
 }
 
 
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libcadu/libcadu.h"
+
+// Buffered output of frames and payloads to a file descriptor, in place of
+// writing through std::cout one frame or byte at a time.
+//
+// Output is gathered into a large aligned buffer and written out whole. Batches
+// of CADUs can instead be written straight from where they are with writev.
+//
+// With direct set and the output a regular file, the page cache is bypassed
+// (O_DIRECT), which suits writing captures far larger than memory. Every write
+// is then a whole buffer, apart from the last, which is written after turning
+// O_DIRECT back off. If the file rejects direct writes, e.g. because it isn't
+// being written from an aligned offset, output carries on without it.
+class OutputSink {
+public:
+  static constexpr std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+  static constexpr std::size_t ALIGNMENT = 4096;
+
+  explicit OutputSink(int fd, bool direct = false, std::size_t buffer_size = DEFAULT_BUFFER_SIZE)
+    : fd{fd}, capacity{std::max((buffer_size + ALIGNMENT - 1) / ALIGNMENT, std::size_t{1}) * ALIGNMENT},
+      buffer{static_cast<std::byte*>(std::aligned_alloc(ALIGNMENT, capacity))} {
+    if (!buffer) {
+      throw std::bad_alloc();
+    }
+    if (direct) {
+      struct stat st;
+      this->direct = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && set_direct(true);
+    }
+  }
+
+  OutputSink(OutputSink const &) = delete;
+  auto operator=(OutputSink const &) -> OutputSink & = delete;
+
+  // Errors can't be reported from here, so call flush() first to see them
+  ~OutputSink() {
+    try {
+      flush();
+    } catch (std::system_error const &) {
+    }
+  }
+
+  void write(std::span<std::byte const> bytes) {
+    // Large writes skip the buffer, unless it is needed for alignment
+    if (!direct && used == 0 && bytes.size() >= capacity) {
+      write_all(bytes.data(), bytes.size());
+      return;
+    }
+
+    while (!bytes.empty()) {
+      auto n = std::min(bytes.size(), capacity - used);
+      std::memcpy(buffer.get() + used, bytes.data(), n);
+      used += n;
+      bytes = bytes.subspan(n);
+      if (used == capacity) {
+        drain();
+      }
+    }
+  }
+
+  // Writes a CADU as it would be in a nonrandomised stream
+  void write(CADU const & cadu) {
+    if (capacity - used < CADU_LEN) {
+      // Fill the buffer exactly, so that direct writes stay whole buffers
+      alignas(8) std::array<std::byte, CADU_LEN> frame;
+      cadu.copy_to(frame);
+      write(frame);
+      return;
+    }
+    cadu.copy_to(std::span<std::byte, CADU_LEN>(buffer.get() + used, CADU_LEN));
+    used += CADU_LEN;
+    if (used == capacity) {
+      drain();
+    }
+  }
+
+  // Writes a batch of CADUs, straight from where they are with writev when
+  // their checksums are all up to date
+  void write(std::span<CADU const> cadus) {
+    if (direct || std::ranges::any_of(cadus, [](CADU const & cadu) { return cadu.dirty(); })) {
+      for (auto const & cadu : cadus) {
+        write(cadu);
+      }
+      return;
+    }
+
+    drain();
+    std::vector<iovec> frames;
+    frames.reserve(cadus.size());
+    for (auto const & cadu : cadus) {
+      auto bytes = cadu.bytes();
+      frames.push_back({const_cast<std::byte*>(bytes.data()), bytes.size()});
+    }
+    writev_all(frames);
+  }
+
+  // Writes out everything buffered
+  void flush() {
+    if (direct && used % ALIGNMENT != 0) {
+      // The tail can't be written directly
+      direct = false;
+      set_direct(false);
+    }
+    drain();
+  }
+
+private:
+  static constexpr std::size_t CADU_LEN = sizeof(cadu::SYNC_MARKER) + sizeof(CVCDU);
+
+  struct Free {
+    void operator()(std::byte *p) const {
+      std::free(p);
+    }
+  };
+
+  int fd;
+  bool direct = false;
+  std::size_t capacity;
+  std::unique_ptr<std::byte[], Free> buffer;
+  std::size_t used = 0;
+
+  auto set_direct(bool on) -> bool {
+    auto flags = ::fcntl(fd, F_GETFL);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+  }
+
+  void drain() {
+    write_all(buffer.get(), used);
+    used = 0;
+  }
+
+  void write_all(std::byte const *data, std::size_t size) {
+    while (size > 0) {
+      auto n = ::write(fd, data, size);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EINVAL && direct) {
+          direct = false;
+          set_direct(false);
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "could not write output");
+      }
+      data += n;
+      size -= n;
+    }
+  }
+
+  void writev_all(std::span<iovec> remaining) {
+    while (!remaining.empty()) {
+      auto n = ::writev(fd, remaining.data(), std::min<std::size_t>(remaining.size(), IOV_MAX));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "could not write output");
+      }
+
+      // Skip whatever was written, which may end part way through an entry
+      while (!remaining.empty() && static_cast<std::size_t>(n) >= remaining.front().iov_len) {
+        n -= remaining.front().iov_len;
+        remaining = remaining.subspan(1);
+      }
+      if (n > 0) {
+        remaining.front().iov_base = static_cast<std::byte*>(remaining.front().iov_base) + n;
+        remaining.front().iov_len -= n;
+      }
+    }
+  }
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "libcadu/libcadu.h"
+
+namespace cadu {
+  constexpr std::size_t PACKET_PRIMARY_HEADER_LEN = 6;
+  constexpr int APP_ID_LEN = 11;
+  constexpr int FILL_APP_ID = (1 << APP_ID_LEN) - 1;
+  // First header pointer of a CADU in which no packet starts
+  constexpr int NO_FIRST_HEADER = (1 << FIRST_HEADER_POINTER_LEN) - 1;
+
+  inline auto packet_app_id(std::span<std::byte const> header) -> int {
+    return std::to_integer<int>(header[0] & std::byte{0x07}) << 8 | std::to_integer<int>(header[1]);
+  }
+
+  // Length of a packet after its primary header. The packet data length field
+  // holds one less than this.
+  inline auto packet_data_len(std::span<std::byte const> header) -> std::size_t {
+    return (std::to_integer<std::size_t>(header[4]) << 8 | std::to_integer<std::size_t>(header[5])) + 1;
+  }
+}
+
+// A run of bytes belonging to one packet, found by a PacketWalker
+struct PacketSegment {
+  std::span<std::byte const> bytes;
+  bool start; // Whether this is the packet's primary header, which starts it
+  bool end;   // Whether this completes the packet
+  bool fill;  // Whether the packet is a fill packet
+};
+
+// Follows the CCSDS packets carried in the data of consecutive CADUs on one
+// virtual channel, from only their primary headers, without building packets.
+//
+// Packets are walked from the first header pointer of the first CADU with one,
+// and their bytes passed on in order as segments. A primary header split over
+// two CADUs is gathered and passed on whole, once it is known whether it is
+// that of a fill packet (APID 0x7ff). Bytes before the first header, and a
+// trailing partial header, are never passed on.
+//
+// The first header pointer of every later CADU is checked against where the
+// walk says the next packet starts. If they disagree, any packet in progress
+// is abandoned without being completed, and walking starts again from the
+// first header pointer.
+class PacketWalker {
+public:
+  // Walks the data of the next CADU, calling on_segment for each run of packet
+  // bytes in it. Returns false if its first header pointer disagreed with the walk.
+  template <typename F>
+  auto walk(CADU const & cadu, F && on_segment) -> bool {
+    std::span<std::byte const> data = cadu.data();
+    // Anything past the end of the data is taken to mean there is no header in it
+    std::size_t first_header = cadu.first_header_pointer();
+    if (first_header >= cadu::DATA_LEN) {
+      first_header = cadu::NO_FIRST_HEADER;
+    }
+
+    bool agreed = true;
+    if (synchronised && first_header != next_header(data)) {
+      agreed = false;
+      reset();
+    }
+    if (!synchronised) {
+      if (first_header >= cadu::DATA_LEN) {
+        return agreed;
+      }
+      data = data.subspan(first_header);
+      synchronised = true;
+    }
+
+    while (!data.empty()) {
+      if (remaining > 0) {
+        auto n = std::min<std::size_t>(remaining, data.size());
+        remaining -= n;
+        on_segment(PacketSegment{data.first(n), false, remaining == 0, fill});
+        data = data.subspan(n);
+        continue;
+      }
+
+      // Headers within the data are passed on from where they are, and only split headers gathered
+      std::span<std::byte const> header_bytes;
+      if (header_used == 0 && data.size() >= header.size()) {
+        header_bytes = data.first(header.size());
+        data = data.subspan(header.size());
+      } else {
+        auto n = std::min(header.size() - header_used, data.size());
+        std::copy_n(data.begin(), n, header.begin() + header_used);
+        header_used += n;
+        data = data.subspan(n);
+        if (header_used < header.size()) {
+          break;
+        }
+        header_bytes = std::span(header);
+      }
+
+      fill = cadu::packet_app_id(header_bytes) == cadu::FILL_APP_ID;
+      remaining = cadu::packet_data_len(header_bytes);
+      header_used = 0;
+      on_segment(PacketSegment{header_bytes, true, false, fill});
+    }
+    return agreed;
+  }
+
+  // Forgets the packet being walked, so walking starts again at the next first header pointer
+  void reset() {
+    synchronised = false;
+    remaining = 0;
+    header_used = 0;
+  }
+
+private:
+  bool synchronised = false;
+  std::array<std::byte, cadu::PACKET_PRIMARY_HEADER_LEN> header {};
+  std::size_t header_used = 0;
+  std::size_t remaining = 0; // Bytes of the current packet after its primary header
+  bool fill = false;
+
+  // Where the first packet starting in the data should be, going by the walk so far
+  auto next_header(std::span<std::byte const> data) const -> std::size_t {
+    auto at = remaining;
+    if (header_used > 0) {
+      // The rest of a split header is at the start of the data
+      auto rest = header.size() - header_used;
+      auto complete = header;
+      std::copy_n(data.begin(), rest, complete.begin() + header_used);
+      at = rest + cadu::packet_data_len(complete);
+    }
+    return at < cadu::DATA_LEN ? at : cadu::NO_FIRST_HEADER;
+  }
+};
+
+// Counts kept by a PacketReassembler as it runs
+struct ReassemblyStats {
+  std::uint64_t packets = 0;
+  std::uint64_t fill_packets = 0;
+  std::uint64_t repeats = 0; // Frames repeating the VCDU counter of the one before on their channel, which are skipped
+  std::uint64_t gaps = 0; // Breaks in the VCDU counter of a virtual channel
+  std::uint64_t frames_lost = 0; // Frames missing from those breaks
+  std::uint64_t backward = 0; // Times the VCDU counter of a virtual channel stepped backwards
+  std::uint64_t resyncs = 0; // Times a first header pointer disagreed with the packets before it
+  std::uint64_t packets_dropped = 0; // Partial packets abandoned at gaps, backward steps and resyncs
+};
+
+// Reassembles whole CCSDS packets from the M_PDUs of CADUs, keeping each
+// virtual channel apart.
+//
+// The VCDU counter of each channel is followed, and when frames are missing,
+// the packet in progress is abandoned and the channel resynchronised at the
+// next first header pointer, so a lost frame costs only the packets it held.
+// A frame with the same counter as the one before it on its channel is taken
+// to be a duplicate, as lossy captures often have, and skipped. A step that
+// would lose half the counter's range or more is taken as the counter going
+// backwards, as replayed or reordered frames do. It breaks the packets as a
+// gap does, but loses no frames.
+// Only whole packets are passed on. Those within a single CADU are passed on
+// from where they are, and the rest gathered first. Fill CADUs are skipped.
+// The span passed on is only valid during the call.
+class PacketReassembler {
+public:
+  using Stats = ReassemblyStats;
+
+  // Takes the next CADU, calling on_packet(vcid, packet) for each packet it completes
+  template <typename F>
+  void push(CADU const & cadu, F && on_packet) {
+    if (cadu.is_fill()) {
+      return;
+    }
+
+    auto vcid = cadu.vcid();
+    auto & channel = channels[vcid];
+    auto counter = cadu.vcdu_counter();
+    if (channel.counter == counter) {
+      stats.repeats++;
+      return;
+    }
+    if (channel.counter) {
+      auto lost = (counter - *channel.counter - 1) & COUNTER_MASK;
+      if (lost >= MAX_GAP) {
+        stats.backward++;
+      } else if (lost) {
+        stats.gaps++;
+        stats.frames_lost += lost;
+      }
+      if (lost) {
+        if (channel.in_packet) {
+          stats.packets_dropped++;
+        }
+        channel.walker.reset();
+        channel.drop();
+      }
+    }
+    channel.counter = counter;
+
+    auto agreed = channel.walker.walk(cadu, [&](PacketSegment const & segment) {
+      if (segment.start) {
+        // A packet still in progress was abandoned by the walker
+        if (channel.in_packet) {
+          stats.packets_dropped++;
+        }
+        channel.drop();
+        channel.in_packet = true;
+        channel.view = segment.bytes;
+      } else if (!channel.view.empty() && segment.bytes.data() == channel.view.data() + channel.view.size()) {
+        channel.view = {channel.view.data(), channel.view.size() + segment.bytes.size()};
+      } else {
+        channel.gather();
+        channel.buffer.insert(channel.buffer.end(), segment.bytes.begin(), segment.bytes.end());
+      }
+
+      if (segment.end) {
+        stats.packets++;
+        if (segment.fill) {
+          stats.fill_packets++;
+        }
+        on_packet(vcid, channel.view.empty() ? std::span<std::byte const>(channel.buffer) : channel.view);
+        channel.drop();
+      }
+    });
+    if (!agreed) {
+      stats.resyncs++;
+    }
+
+    // A packet continuing into the next CADU can't be left where it is
+    channel.gather();
+  }
+
+  auto statistics() const -> Stats const & {
+    return stats;
+  }
+
+private:
+  static constexpr int COUNTER_MASK = (1 << cadu::VCDU_COUNTER_LEN) - 1;
+  static constexpr int MAX_GAP = 1 << (cadu::VCDU_COUNTER_LEN - 1);
+
+  struct Channel {
+    PacketWalker walker;
+    std::optional<int> counter;
+    bool in_packet = false;
+    std::span<std::byte const> view; // The packet so far, while it is all in one place
+    std::vector<std::byte> buffer; // The packet so far, otherwise
+
+    // Copies the packet so far out of where it is
+    void gather() {
+      if (!view.empty()) {
+        buffer.assign(view.begin(), view.end());
+        view = {};
+      }
+    }
+
+    void drop() {
+      in_packet = false;
+      view = {};
+      buffer.clear();
+    }
+  };
+
+  std::array<Channel, 1 << cadu::VCID_LEN> channels;
+  Stats stats;
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/file.h"
+
+// Runs tasks on a fixed set of threads, each with its own queue. Tasks are
+// queued round robin, and a thread with nothing left in its own queue takes
+// the oldest task from the next queue that has one. With no threads, tasks
+// are run as they are submitted.
+class WorkPool {
+public:
+  using Task = std::function<void()>;
+
+  explicit WorkPool(unsigned threads) : queues(threads) {
+    for (unsigned i = 0; i < threads; i++) {
+      workers.emplace_back([this, i](std::stop_token stop) { work(stop, i); });
+    }
+  }
+
+  WorkPool(WorkPool const &) = delete;
+  auto operator=(WorkPool const &) -> WorkPool & = delete;
+
+  void submit(Task task) {
+    if (queues.empty()) {
+      task();
+      return;
+    }
+
+    auto & queue = queues[next++ % queues.size()];
+    {
+      std::lock_guard lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard lock(mutex);
+      queued++;
+    }
+    task_available.notify_one();
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<Queue> queues;
+  std::size_t next = 0;
+
+  // Tasks queued and not yet claimed by a thread
+  std::mutex mutex;
+  std::condition_variable_any task_available;
+  std::size_t queued = 0;
+
+  // Last, so the threads are stopped before anything they use is destroyed
+  std::vector<std::jthread> workers;
+
+  auto take(std::size_t own) -> std::optional<Task> {
+    for (std::size_t i = 0; i < queues.size(); i++) {
+      auto & queue = queues[(own + i) % queues.size()];
+      std::lock_guard lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        auto task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return task;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void work(std::stop_token stop, std::size_t own) {
+    while (true) {
+      {
+        std::unique_lock lock(mutex);
+        if (!task_available.wait(lock, stop, [this] { return queued > 0; })) {
+          return;
+        }
+        queued--;
+      }
+
+      // Having claimed a task, there is one for this thread in some queue,
+      // though another thread may take it from under a first look
+      std::optional<Task> task;
+      while (!(task = take(own))) {
+        std::this_thread::yield();
+      }
+      (*task)();
+    }
+  }
+};
+
+// Runs a transform over a stream of items, usually CADUs, in chunks on a
+// WorkPool, and passes the chunks on to a sink in the order they were filled.
+//
+// The transform runs on the pool's threads, a chunk at a time, and must only
+// touch the chunk it is given. The sink runs on the thread filling the chunks.
+// At most depth chunks are in flight at once. Submitting another waits for the
+// oldest to be passed on, which holds back the producer when the transform or
+// the sink can't keep up, and bounds how far ahead of the sink the pool gets.
+//
+// An exception thrown by the transform is rethrown, once, by the call to
+// submit() or finish() that would have passed its chunk on, and the chunk is
+// dropped. Later chunks are passed on as usual.
+template <typename Item = CADU>
+class Pipeline {
+public:
+  using Transform = std::function<void(std::span<Item>)>;
+  using Sink = std::function<void(std::span<Item>)>;
+
+  static constexpr std::size_t DEFAULT_CHUNK_SIZE = 256;
+
+  // With threads at 1 or less, each chunk is transformed as it is submitted.
+  // A depth of 0 chooses one that keeps every thread busy.
+  Pipeline(unsigned threads, Transform transform, Sink sink, std::size_t chunk_size = DEFAULT_CHUNK_SIZE, std::size_t depth = 0)
+    : transform{std::move(transform)}, sink{std::move(sink)}, chunk_len{std::max<std::size_t>(chunk_size, 1)},
+      slots(depth > 0 ? depth : 2 * std::max(threads, 1u) + 1), pool{threads > 1 ? threads : 0} {
+    for (auto & slot : slots) {
+      slot.items.reserve(chunk_len);
+    }
+  }
+
+  Pipeline(Pipeline const &) = delete;
+  auto operator=(Pipeline const &) -> Pipeline & = delete;
+
+  // The chunk being filled. It should be submitted once it holds chunk_size()
+  // items, and items must not be added beyond that, so they are never moved.
+  auto filling() -> std::vector<Item> & {
+    return slots[(head + in_flight) % slots.size()].items;
+  }
+
+  auto chunk_size() const -> std::size_t {
+    return chunk_len;
+  }
+
+  // Hands the chunk being filled over to be transformed, and passes on any
+  // chunks that are done
+  void submit() {
+    auto & slot = slots[(head + in_flight) % slots.size()];
+    if (slot.items.empty()) {
+      return;
+    }
+
+    {
+      std::lock_guard lock(mutex);
+      slot.done = false;
+    }
+    in_flight++;
+    pool.submit([this, &slot] {
+      std::exception_ptr failure;
+      try {
+        transform(slot.items);
+      } catch (...) {
+        failure = std::current_exception();
+      }
+      {
+        std::lock_guard lock(mutex);
+        slot.error = failure;
+        slot.done = true;
+      }
+      chunk_done.notify_all();
+    });
+
+    // Make room for the next chunk
+    pass_on(in_flight == slots.size());
+  }
+
+  // Submits whatever has been filled, and waits for every chunk to be passed on
+  void finish() {
+    submit();
+    while (in_flight > 0) {
+      pass_on(true);
+    }
+  }
+
+  // Fills chunks from a nonrandomised stream until it ends, then finishes
+  void read(CaduReader & reader) requires std::same_as<Item, CADU> {
+    while (true) {
+      auto & chunk = filling();
+      if (!nonrandomised::operator>>(reader, chunk.emplace_back())) {
+        chunk.pop_back();
+        break;
+      }
+      if (chunk.size() == chunk_len) {
+        submit();
+      }
+    }
+    finish();
+  }
+
+  // Fills chunks from the frames of a mapped capture, then finishes
+  void read(CaduFile const & file) requires std::same_as<Item, CADU> {
+    for (std::size_t i = 0; i < file.size(); i++) {
+      auto & chunk = filling();
+      chunk.emplace_back(file.cadu(i));
+      if (chunk.size() == chunk_len) {
+        submit();
+      }
+    }
+    finish();
+  }
+
+private:
+  struct Slot {
+    std::vector<Item> items;
+    bool done = true;
+    std::exception_ptr error; // Thrown by the transform of the chunk
+  };
+
+  Transform transform;
+  Sink sink;
+  std::size_t chunk_len;
+
+  // Ring of chunks, from the oldest in flight at head, to the one being filled
+  std::vector<Slot> slots;
+  std::size_t head = 0;
+  std::size_t in_flight = 0;
+
+  // Empties a chunk when it goes out of scope, however that happens
+  struct Clear {
+    std::vector<Item> & items;
+
+    ~Clear() {
+      items.clear();
+    }
+  };
+
+  std::mutex mutex;
+  std::condition_variable chunk_done;
+
+  // Last, so the threads are stopped before anything they use is destroyed
+  WorkPool pool;
+
+  // Passes on chunks that are done, oldest first, waiting for the oldest if wait is set
+  void pass_on(bool wait) {
+    while (in_flight > 0) {
+      auto & slot = slots[head];
+      std::exception_ptr error;
+      {
+        std::unique_lock lock(mutex);
+        if (wait) {
+          chunk_done.wait(lock, [&slot] { return slot.done; });
+          wait = false;
+        } else if (!slot.done) {
+          break;
+        }
+        error = std::exchange(slot.error, nullptr);
+      }
+
+      // The chunk is done with before anything can throw, so an error is only
+      // ever thrown once, and its slot is free for filling even if the sink throws
+      head = (head + 1) % slots.size();
+      in_flight--;
+      Clear clear{slot.items};
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      sink(slot.items);
+    }
+  }
+};
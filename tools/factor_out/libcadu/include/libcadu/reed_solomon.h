@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Reed-Solomon (255,223) encoder and decoder for the CCSDS TM sync and channel
+// coding standard, interleaved to depth 4 as used by CVCDUs
+// Described in sec 4 https://public.ccsds.org/Pubs/131x0b3e1.pdf
+//
+// Bit-exact with libfec's encode_rs_ccsds, including the conversion to and
+// from the dual basis representation used on the wire.
+//
+// The parity register of each codeword is held as four 64-bit words. For each
+// data symbol, the register is shifted by one symbol and the generator
+// polynomial multiplied by the feedback symbol is XORed in. That product is
+// looked up from two tables indexed by the low and high nibbles of the
+// feedback, so each step is two 32-byte table rows and a handful of word-wide
+// XORs, with the four interleaved codewords processed side by side.
+//
+// Decoding starts by re-encoding the data. Frames without errors stop there,
+// at the cost of one encode. Otherwise the syndromes only need evaluating over
+// the difference between the received and recalculated parity, before
+// the usual Berlekamp-Massey, Chien search and Forney steps, following
+// libfec's decode_rs.
+namespace cadu::rs {
+  constexpr int SYMBOLS = 255;
+  constexpr int DATA_SYMBOLS = 223;
+  constexpr int PARITY_SYMBOLS = 32;
+  constexpr int INTERLEAVE = 4;
+  constexpr unsigned FIELD_POLY = 0x187;  // x^8 + x^7 + x^2 + x + 1
+  constexpr int FIRST_ROOT = 112;
+  constexpr int ROOT_SPACING = 11;
+  constexpr int ROOT_SPACING_INVERSE = 116;  // ROOT_SPACING * ROOT_SPACING_INVERSE == 1 mod SYMBOLS
+  constexpr int MAX_CORRECTABLE = PARITY_SYMBOLS / 2;
+
+  // Rows of the dual basis transformation matrix
+  constexpr std::array<uint8_t, 8> DUAL_BASIS = {0x8d, 0xef, 0xec, 0x86, 0xfa, 0x99, 0xaf, 0x7b};
+
+  using Register = std::array<uint64_t, PARITY_SYMBOLS / 8>;
+
+  struct Tables {
+    std::array<uint8_t, 256> exp {};     // alpha^i
+    std::array<int, 256> log {};         // i such that alpha^i == x, with log(0) == 255
+    std::array<uint8_t, PARITY_SYMBOLS + 1> generator {};  // Coefficients, lowest order first
+    std::array<uint8_t, 256> to_dual {};
+    std::array<uint8_t, 256> from_dual {};
+    std::array<Register, 16> product_low {};   // generator * n
+    std::array<Register, 16> product_high {};  // generator * (n << 4)
+    std::array<int, PARITY_SYMBOLS> syndrome_root {};  // log of the root each syndrome is evaluated at
+
+    constexpr auto multiply(uint8_t a, uint8_t b) const -> uint8_t {
+      if (a == 0 || b == 0) {
+        return 0;
+      }
+      return exp[(log[a] + log[b]) % SYMBOLS];
+    }
+  };
+
+  constexpr auto make_tables() -> Tables {
+    Tables t;
+
+    // Galois field
+    unsigned x = 1;
+    for (int i = 0; i < SYMBOLS; i++) {
+      t.exp[i] = x;
+      t.log[x] = i;
+      x <<= 1;
+      if (x & 0x100) {
+        x ^= FIELD_POLY;
+      }
+    }
+    t.exp[SYMBOLS] = 0;
+    t.log[0] = SYMBOLS;
+
+    // Generator polynomial, prod (x - alpha^(ROOT_SPACING * (FIRST_ROOT + i)))
+    t.generator[0] = 1;
+    for (int i = 0; i < PARITY_SYMBOLS; i++) {
+      auto root = t.exp[(ROOT_SPACING * (FIRST_ROOT + i)) % SYMBOLS];
+      t.generator[i + 1] = 1;
+      for (int j = i; j > 0; j--) {
+        t.generator[j] = t.generator[j - 1] ^ t.multiply(t.generator[j], root);
+      }
+      t.generator[0] = t.multiply(t.generator[0], root);
+    }
+
+    // Dual basis conversion
+    for (int i = 0; i < 256; i++) {
+      uint8_t dual = 0;
+      for (int bit = 0; bit < 8; bit++) {
+        if (i & (1 << bit)) {
+          dual ^= DUAL_BASIS[7 - bit];
+        }
+      }
+      t.to_dual[i] = dual;
+      t.from_dual[dual] = i;
+    }
+
+    // Shifting the register drops symbol 0, so symbol k takes the
+    // coefficient that was one place higher
+    for (int n = 0; n < 16; n++) {
+      for (int k = 0; k < PARITY_SYMBOLS; k++) {
+        auto coefficient = t.generator[PARITY_SYMBOLS - 1 - k];
+        t.product_low[n][k / 8] |= uint64_t{t.multiply(coefficient, n)} << (8 * (k % 8));
+        t.product_high[n][k / 8] |= uint64_t{t.multiply(coefficient, n << 4)} << (8 * (k % 8));
+      }
+    }
+
+    for (int i = 0; i < PARITY_SYMBOLS; i++) {
+      t.syndrome_root[i] = (ROOT_SPACING * (FIRST_ROOT + i)) % SYMBOLS;
+    }
+
+    return t;
+  }
+
+  inline constexpr Tables tables = make_tables();
+
+  static_assert(tables.generator[PARITY_SYMBOLS] == 1, "generator polynomial is not monic");
+  static_assert((ROOT_SPACING * ROOT_SPACING_INVERSE) % SYMBOLS == 1, "ROOT_SPACING_INVERSE is not the inverse of ROOT_SPACING");
+  static_assert(tables.from_dual[tables.to_dual[0xa5]] == 0xa5, "dual basis conversion is not invertible");
+
+  // Feeds one (conventional basis) data symbol through a parity register
+  inline void step(Register &reg, uint8_t symbol) {
+    uint8_t feedback = symbol ^ static_cast<uint8_t>(reg[0]);
+    auto const &low = tables.product_low[feedback & 0x0f];
+    auto const &high = tables.product_high[feedback >> 4];
+    for (std::size_t i = 0; i < reg.size() - 1; i++) {
+      reg[i] = ((reg[i] >> 8) | (reg[i + 1] << 56)) ^ low[i] ^ high[i];
+    }
+    reg.back() = (reg.back() >> 8) ^ low.back() ^ high.back();
+  }
+
+  // Calculates the parity of the four codewords interleaved through data,
+  // interleaving the parity symbols in the same way
+  inline void encode(std::span<std::byte const, INTERLEAVE * DATA_SYMBOLS> data,
+                     std::span<std::byte, INTERLEAVE * PARITY_SYMBOLS> parity) {
+    std::array<Register, INTERLEAVE> regs {};
+    for (int i = 0; i < DATA_SYMBOLS; i++) {
+      for (int c = 0; c < INTERLEAVE; c++) {
+        step(regs[c], tables.from_dual[std::to_integer<uint8_t>(data[INTERLEAVE * i + c])]);
+      }
+    }
+
+    for (int k = 0; k < PARITY_SYMBOLS; k++) {
+      for (int c = 0; c < INTERLEAVE; c++) {
+        parity[INTERLEAVE * k + c] = std::byte{tables.to_dual[static_cast<uint8_t>(regs[c][k / 8] >> (8 * (k % 8)))]};
+      }
+    }
+  }
+
+  constexpr auto modnn(int x) -> int {
+    return x % SYMBOLS;
+  }
+
+  // Corrects one codeword (conventional basis, highest order symbol first) in place
+  // given the difference between its received and recalculated parity
+  // Returns the number of symbols corrected, or -1 if it has too many errors
+  inline auto correct(std::array<uint8_t, SYMBOLS> &codeword, std::array<uint8_t, PARITY_SYMBOLS> const &difference) -> int {
+    auto const &t = tables;
+    constexpr int A0 = SYMBOLS;  // log(0)
+
+    // Syndromes, in log form. The recalculated codeword has zero syndromes,
+    // so only the parity difference contributes
+    std::array<int, PARITY_SYMBOLS> s;
+    bool errors = false;
+    for (int i = 0; i < PARITY_SYMBOLS; i++) {
+      uint8_t value = 0;
+      for (auto d : difference) {
+        value = d ^ (value == 0 ? 0 : t.exp[modnn(t.log[value] + t.syndrome_root[i])]);
+      }
+      s[i] = t.log[value];
+      errors |= value != 0;
+    }
+    if (!errors) {
+      return 0;
+    }
+
+    // Berlekamp-Massey, finding the error locator polynomial lambda
+    std::array<uint8_t, PARITY_SYMBOLS + 1> lambda {};
+    std::array<int, PARITY_SYMBOLS + 1> b;
+    std::array<uint8_t, PARITY_SYMBOLS + 1> next;
+    lambda[0] = 1;
+    for (int i = 0; i <= PARITY_SYMBOLS; i++) {
+      b[i] = t.log[lambda[i]];
+    }
+
+    int el = 0;
+    for (int r = 1; r <= PARITY_SYMBOLS; r++) {
+      uint8_t discrepancy = 0;
+      for (int i = 0; i < r; i++) {
+        if (lambda[i] != 0 && s[r - i - 1] != A0) {
+          discrepancy ^= t.exp[modnn(t.log[lambda[i]] + s[r - i - 1])];
+        }
+      }
+      auto discr = t.log[discrepancy];
+
+      if (discr == A0) {
+        std::copy_backward(b.begin(), b.end() - 1, b.end());
+        b[0] = A0;
+        continue;
+      }
+
+      next[0] = lambda[0];
+      for (int i = 0; i < PARITY_SYMBOLS; i++) {
+        next[i + 1] = b[i] != A0 ? lambda[i + 1] ^ t.exp[modnn(discr + b[i])] : lambda[i + 1];
+      }
+      if (2 * el <= r - 1) {
+        el = r - el;
+        for (int i = 0; i <= PARITY_SYMBOLS; i++) {
+          b[i] = lambda[i] == 0 ? A0 : modnn(t.log[lambda[i]] - discr + SYMBOLS);
+        }
+      } else {
+        std::copy_backward(b.begin(), b.end() - 1, b.end());
+        b[0] = A0;
+      }
+      lambda = next;
+    }
+
+    std::array<int, PARITY_SYMBOLS + 1> lambda_log;
+    int deg_lambda = 0;
+    for (int i = 0; i <= PARITY_SYMBOLS; i++) {
+      lambda_log[i] = t.log[lambda[i]];
+      if (lambda_log[i] != A0) {
+        deg_lambda = i;
+      }
+    }
+    if (deg_lambda > MAX_CORRECTABLE) {
+      return -1;
+    }
+
+    // Chien search for the roots of lambda, giving the error locations
+    std::array<int, MAX_CORRECTABLE> root;
+    std::array<int, MAX_CORRECTABLE> location;
+    auto reg = lambda_log;
+    int count = 0;
+    for (int i = 1, k = ROOT_SPACING_INVERSE - 1; i <= SYMBOLS; i++, k = modnn(k + ROOT_SPACING_INVERSE)) {
+      uint8_t q = 1;
+      for (int j = deg_lambda; j > 0; j--) {
+        if (reg[j] != A0) {
+          reg[j] = modnn(reg[j] + j);
+          q ^= t.exp[reg[j]];
+        }
+      }
+      if (q != 0) {
+        continue;
+      }
+      root[count] = i;
+      location[count] = k;
+      if (++count == deg_lambda) {
+        break;
+      }
+    }
+    if (count != deg_lambda) {
+      return -1;
+    }
+
+    // Error evaluator omega = s * lambda mod x^PARITY_SYMBOLS, in log form
+    int deg_omega = deg_lambda - 1;
+    std::array<int, MAX_CORRECTABLE> omega;
+    for (int i = 0; i <= deg_omega; i++) {
+      uint8_t value = 0;
+      for (int j = i; j >= 0; j--) {
+        if (s[i - j] != A0 && lambda_log[j] != A0) {
+          value ^= t.exp[modnn(s[i - j] + lambda_log[j])];
+        }
+      }
+      omega[i] = t.log[value];
+    }
+
+    // Forney, giving the error values
+    for (int j = count - 1; j >= 0; j--) {
+      uint8_t numerator = 0;
+      for (int i = deg_omega; i >= 0; i--) {
+        if (omega[i] != A0) {
+          numerator ^= t.exp[modnn(omega[i] + i * root[j])];
+        }
+      }
+      auto root_power = t.exp[modnn(root[j] * (FIRST_ROOT - 1) + SYMBOLS)];
+
+      uint8_t denominator = 0;
+      for (int i = std::min(deg_lambda, PARITY_SYMBOLS - 1) & ~1; i >= 0; i -= 2) {
+        if (lambda_log[i + 1] != A0) {
+          denominator ^= t.exp[modnn(lambda_log[i + 1] + i * root[j])];
+        }
+      }
+
+      if (denominator == 0) {
+        return -1;
+      }
+      if (numerator != 0) {
+        codeword[location[j]] ^= t.exp[modnn(t.log[numerator] + t.log[root_power] + SYMBOLS - t.log[denominator])];
+      }
+    }
+    return count;
+  }
+
+  // Corrects errors in the four codewords interleaved through data and parity, in place
+  // Returns the number of symbols corrected in each codeword, or -1 where a
+  // codeword has more errors than can be corrected, in which case it is left untouched
+  inline auto decode(std::span<std::byte, INTERLEAVE * DATA_SYMBOLS> data,
+                     std::span<std::byte, INTERLEAVE * PARITY_SYMBOLS> parity) -> std::array<int, INTERLEAVE> {
+    std::array<std::byte, INTERLEAVE * PARITY_SYMBOLS> expected;
+    encode(data, expected);
+
+    std::array<int, INTERLEAVE> corrected {};
+    if (std::equal(expected.begin(), expected.end(), parity.begin())) {
+      return corrected;
+    }
+
+    for (int c = 0; c < INTERLEAVE; c++) {
+      // The dual basis conversion is linear, so differences can be converted directly
+      std::array<uint8_t, PARITY_SYMBOLS> difference;
+      bool differs = false;
+      for (int k = 0; k < PARITY_SYMBOLS; k++) {
+        difference[k] = tables.from_dual[std::to_integer<uint8_t>(parity[INTERLEAVE * k + c] ^ expected[INTERLEAVE * k + c])];
+        differs |= difference[k] != 0;
+      }
+      if (!differs) {
+        continue;
+      }
+
+      std::array<uint8_t, SYMBOLS> codeword;
+      for (int i = 0; i < DATA_SYMBOLS; i++) {
+        codeword[i] = tables.from_dual[std::to_integer<uint8_t>(data[INTERLEAVE * i + c])];
+      }
+      for (int k = 0; k < PARITY_SYMBOLS; k++) {
+        codeword[DATA_SYMBOLS + k] = tables.from_dual[std::to_integer<uint8_t>(parity[INTERLEAVE * k + c])];
+      }
+
+      corrected[c] = correct(codeword, difference);
+      if (corrected[c] <= 0) {
+        continue;
+      }
+
+      for (int i = 0; i < DATA_SYMBOLS; i++) {
+        data[INTERLEAVE * i + c] = std::byte{tables.to_dual[codeword[i]]};
+      }
+      for (int k = 0; k < PARITY_SYMBOLS; k++) {
+        parity[INTERLEAVE * k + c] = std::byte{tables.to_dual[codeword[DATA_SYMBOLS + k]]};
+      }
+    }
+    return corrected;
+  }
+}
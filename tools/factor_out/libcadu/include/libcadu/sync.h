@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <streambuf>
+#include <vector>
+
+#include <unistd.h>
+
+#include "libcadu/libcadu.h"
+
+// How a BitSynchroniser matches sync markers
+struct SyncOptions {
+  int max_errors = 0; // Bits of the sync marker allowed to be wrong while locked
+  int search_errors = 0; // Bits of the sync marker allowed to be wrong while searching
+  bool inverted = false; // Also match the inverted sync marker
+  int slip = 1; // Bits either side of the expected position checked for the next marker
+};
+
+// Counts kept by a BitSynchroniser as it runs
+struct SyncStats {
+  std::uint64_t frames = 0;
+  std::uint64_t acquisitions = 0; // Times lock was gained by searching
+  std::uint64_t slips = 0; // Frames found away from where they were expected
+  std::uint64_t inverted = 0; // Frames output inverted
+  std::uint64_t marker_errors = 0; // Sync marker bits wrong, over all frames
+};
+
+// Finds CADUs in a raw bitstream, such as demodulator output, where frames may
+// start at any bit offset, and outputs them byte-aligned.
+//
+// While searching, a 64 bit window is loaded at each byte and the sync marker
+// is compared at all 8 bit offsets within it. Once a marker is found the
+// synchroniser is locked, and only checks for the next marker one frame on,
+// allowing it to have slipped by a few bits either side. If it isn't there the
+// synchroniser goes back to searching from just after the last frame.
+//
+// A marker may match with up to max_errors bits wrong while locked, or
+// search_errors while searching. Keeping search_errors low avoids locking onto
+// random data, and with none allowed the search only looks closely at bytes
+// that could be part of a marker. With inverted set, a marker with all its bits
+// flipped is also matched, as from a demodulator locked 180 degrees out of
+// phase, and the frame is inverted back on output.
+class BitSynchroniser {
+public:
+  static constexpr std::size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+  static constexpr std::size_t FRAME_LEN = sizeof(cadu::SYNC_MARKER) + sizeof(CVCDU);
+  using Frame = std::span<std::byte const, FRAME_LEN>;
+
+  using Options = SyncOptions;
+  using Stats = SyncStats;
+
+  explicit BitSynchroniser(int fd, Options options = {}, std::size_t block_size = DEFAULT_BLOCK_SIZE)
+    : fd{fd}, options{options}, buffer(std::max(block_size, 4 * FRAME_LEN) + PADDING) {}
+
+  explicit BitSynchroniser(std::streambuf *source, Options options = {}, std::size_t block_size = DEFAULT_BLOCK_SIZE)
+    : source{source}, options{options}, buffer(std::max(block_size, 4 * FRAME_LEN) + PADDING) {}
+
+  // Returns the next frame, sync marker included and byte-aligned, or nothing
+  // at the end of the stream. The view is only valid until the next call.
+  auto next() -> std::optional<Frame> {
+    while (true) {
+      if (locked) {
+        // Wait for every position the frame could be at to have arrived
+        if (!eof && tail * 8 < position + options.slip + FRAME_BITS) {
+          fill();
+          continue;
+        }
+
+        if (auto found = find_near(position)) {
+          auto [at, inverted] = *found;
+          if (at != position) {
+            stats.slips++;
+          }
+          auto marker = inverted ? ~cadu::SYNC_MARKER : cadu::SYNC_MARKER;
+          stats.marker_errors += std::popcount(marker_at(at) ^ marker);
+          position = at;
+          extract(inverted);
+          frame_position = consumed_bits + position;
+          last_frame = position;
+          position += FRAME_BITS;
+          return Frame{output.data(), FRAME_LEN};
+        }
+
+        // Lost lock, so search again from just after the last frame, in case
+        // the stream slipped back further than was checked
+        locked = false;
+        position = last_frame ? *last_frame + 1 : position + 1;
+        last_frame.reset();
+        continue;
+      }
+
+      if (search()) {
+        locked = true;
+        stats.acquisitions++;
+        continue;
+      }
+
+      if (eof) {
+        return std::nullopt;
+      }
+      fill();
+    }
+  }
+
+  // Bit offset within the stream of the sync marker of the last frame output
+  auto bit_offset() const -> std::uint64_t {
+    return frame_position;
+  }
+
+  auto statistics() const -> Stats const & {
+    return stats;
+  }
+
+private:
+  static constexpr std::size_t FRAME_BITS = FRAME_LEN * 8;
+  static constexpr std::size_t MARKER_BITS = sizeof(cadu::SYNC_MARKER) * 8;
+  // Zeroed bytes kept past the end of the data, so whole words can always be loaded
+  static constexpr std::size_t PADDING = 16;
+
+  // Whichever bit of a byte a marker starts at, the whole of the next byte is
+  // part of it. This holds those middle bytes for each offset, 1 for an upright
+  // marker and 2 for an inverted one.
+  static constexpr auto MIDDLE_BYTES = []() {
+    std::array<std::uint8_t, 256> middle {};
+    for (int bit = 0; bit < 8; bit++) {
+      auto byte = (cadu::SYNC_MARKER >> (16 + bit)) & 0xff;
+      middle[byte] |= 1;
+      middle[~byte & 0xff] |= 2;
+    }
+    return middle;
+  }();
+
+  int fd = -1;
+  std::streambuf *source = nullptr;
+  Options options;
+  Stats stats;
+
+  std::vector<std::byte> buffer;
+  std::size_t tail = 0;
+  bool eof = false;
+  std::uint64_t consumed_bits = 0; // Stream bit offset of buffer[0]
+  std::size_t position = 0; // Bit offset within the buffer of the next marker
+  std::optional<std::size_t> last_frame; // Bit offset within the buffer of the last frame since lock was gained
+  std::uint64_t frame_position = 0;
+  bool locked = false;
+
+  alignas(8) std::array<std::byte, FRAME_LEN + 8> output {};
+
+  static auto load_be64(std::byte const *data) -> std::uint64_t {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    if constexpr (std::endian::native == std::endian::little) {
+      word = __builtin_bswap64(word);
+    }
+    return word;
+  }
+
+  static auto store_be64(std::byte *data, std::uint64_t word) -> void {
+    if constexpr (std::endian::native == std::endian::little) {
+      word = __builtin_bswap64(word);
+    }
+    std::memcpy(data, &word, sizeof(word));
+  }
+
+  // The 32 bits starting at a bit offset within the buffer
+  auto marker_at(std::size_t bit) const -> std::uint32_t {
+    return load_be64(buffer.data() + bit / 8) >> (MARKER_BITS - bit % 8);
+  }
+
+  // Whether 32 bits are a marker with up to max_errors bits wrong, and if so
+  // whether it is inverted
+  auto match(std::uint32_t candidate, int max_errors) const -> std::optional<bool> {
+    auto errors = std::popcount(candidate ^ cadu::SYNC_MARKER);
+    if (errors <= max_errors) {
+      return false;
+    }
+    if (options.inverted && static_cast<int>(MARKER_BITS) - errors <= max_errors) {
+      return true;
+    }
+    return std::nullopt;
+  }
+
+  // Checks for the marker where it is expected, then progressively further either side
+  auto find_near(std::size_t expected) const -> std::optional<std::pair<std::size_t, bool>> {
+    auto available = tail * 8;
+    for (int distance = 0; distance <= options.slip; distance++) {
+      for (auto at : {expected + distance, expected - distance}) {
+        if (at > expected + distance || at + FRAME_BITS > available) {
+          // Before the start of the buffer, or a partial frame
+          continue;
+        }
+        if (auto inverted = match(marker_at(at), options.max_errors)) {
+          return std::pair{at, *inverted};
+        }
+        if (distance == 0) {
+          break;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Searches for a marker from the current position, leaving the position at it if found
+  auto search() -> bool {
+    auto available = tail * 8;
+    auto bit = position % 8;
+    auto middle_mask = options.inverted ? 3 : 1;
+    for (auto byte = position / 8; byte * 8 + MARKER_BITS <= available; byte++, bit = 0) {
+      if (options.search_errors == 0 && !(MIDDLE_BYTES[std::to_integer<std::uint8_t>(buffer[byte + 1])] & middle_mask)) {
+        continue;
+      }
+      auto window = load_be64(buffer.data() + byte);
+      for (; bit < 8; bit++) {
+        if (byte * 8 + bit + MARKER_BITS > available) {
+          break;
+        }
+        if (match(static_cast<std::uint32_t>(window >> (MARKER_BITS - bit)), options.search_errors)) {
+          position = byte * 8 + bit;
+          return true;
+        }
+      }
+    }
+    // Keep any partial marker for the next block
+    position = available - std::min<std::size_t>(available - std::min(position, available), MARKER_BITS - 1);
+    return false;
+  }
+
+  // Copies the frame at the current position into the output, shifted to be byte-aligned
+  auto extract(bool inverted) -> void {
+    auto first = buffer.data() + position / 8;
+    auto shift = position % 8;
+    auto invert = inverted ? ~std::uint64_t{0} : 0;
+    for (std::size_t i = 0; i < FRAME_LEN; i += sizeof(std::uint64_t)) {
+      auto word = load_be64(first + i);
+      if (shift) {
+        word = word << shift | std::to_integer<std::uint64_t>(first[i + sizeof(std::uint64_t)]) >> (8 - shift);
+      }
+      store_be64(output.data() + i, word ^ invert);
+    }
+    // The marker is output as it should be, whatever errors it was received with
+    std::copy(cadu::SYNC_MARKER_BYTES.begin(), cadu::SYNC_MARKER_BYTES.end(), output.begin());
+    stats.frames++;
+    if (inverted) {
+      stats.inverted++;
+    }
+  }
+
+  // Drops the bytes before the current position, keeping the last frame to
+  // look back through for a slipped marker, and reads another block
+  auto fill() -> void {
+    auto keep_from = std::min(position / 8 - std::min<std::size_t>(position / 8, FRAME_LEN + options.slip / 8 + 1), tail);
+    if (keep_from > 0) {
+      std::memmove(buffer.data(), buffer.data() + keep_from, tail - keep_from);
+      tail -= keep_from;
+      position -= keep_from * 8;
+      if (last_frame) {
+        last_frame = *last_frame - keep_from * 8;
+      }
+      consumed_bits += keep_from * 8;
+    }
+
+    auto destination = buffer.data() + tail;
+    auto space = buffer.size() - PADDING - tail;
+    ssize_t n;
+    if (source) {
+      n = source->sgetn(reinterpret_cast<char*>(destination), space);
+    } else {
+      do {
+        n = ::read(fd, destination, space);
+      } while (n < 0 && errno == EINTR);
+    }
+
+    if (n <= 0) {
+      eof = true;
+    } else {
+      tail += n;
+    }
+    std::fill(buffer.begin() + tail, buffer.end(), std::byte{0});
+  }
+};
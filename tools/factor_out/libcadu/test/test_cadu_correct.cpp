@@ -0,0 +1,101 @@
+// Checks CADU::correct on frames as received with correctable and
+// uncorrectable errors, and on a frame changed after it was received, which
+// must keep its change and have its checksum recalculated rather than being
+// "corrected" back to what was received
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+
+#include "libcadu/libcadu.h"
+
+int failed = 0;
+
+void expect(bool ok, std::string const & what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << '\n';
+    failed++;
+  }
+}
+
+using Received = std::array<std::uint8_t, sizeof(CVCDU)>;
+
+// The CVCDU of a CADU, as it would be received
+auto bytes(CADU const & cadu) -> Received {
+  std::array<std::byte, 4 + sizeof(CVCDU)> copy;
+  cadu.copy_to(copy);
+  Received received;
+  std::transform(copy.begin() + 4, copy.end(), received.begin(), [](std::byte b) { return std::to_integer<std::uint8_t>(b); });
+  return received;
+}
+
+// Flips a symbol of the given codeword, which are interleaved through the whole CVCDU
+void corrupt(Received & received, int codeword, int symbol) {
+  received[cadu::rs::INTERLEAVE * symbol + codeword] ^= 0x5a;
+}
+
+int main() {
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  Received original;
+  for (auto & b : original) {
+    b = byte(random);
+  }
+  CADU clean(original.data());
+  clean.recalculate_checksum();
+  auto sent = bytes(clean);
+
+  {
+    auto received = sent;
+    for (int c = 0; c < cadu::rs::INTERLEAVE; c++) {
+      for (int e = 0; e < 4 * c; e++) {
+        corrupt(received, c, 17 * e + c);
+      }
+    }
+    CADU cadu(received.data());
+    auto corrected = cadu.correct();
+    expect(corrected == std::array{0, 4, 8, 12}, "received: errors counted in each codeword");
+    expect(bytes(cadu) == sent, "received: frame restored");
+    expect(cadu._validate_checksum(), "received: checksum valid afterwards");
+  }
+
+  {
+    auto received = sent;
+    for (int e = 0; e < 20; e++) {
+      corrupt(received, 1, 11 * e);
+    }
+    corrupt(received, 2, 100);
+    CADU cadu(received.data());
+    auto corrected = cadu.correct();
+    expect(corrected == std::array{0, -1, 1, 0}, "uncorrectable: codeword reported as -1");
+    auto got = bytes(cadu);
+    bool kept = true;
+    for (std::size_t i = 0; i < got.size(); i++) {
+      auto codeword = i % cadu::rs::INTERLEAVE;
+      kept &= got[i] == (codeword == 1 ? received[i] : sent[i]);
+    }
+    expect(kept, "uncorrectable: codeword left as received, and the others corrected");
+    expect(!cadu._validate_checksum(), "uncorrectable: received checksum kept");
+  }
+
+  {
+    CADU cadu(sent.data());
+    cadu.vcdu_counter() = cadu.vcdu_counter() + 1;
+    auto changed = bytes(cadu);
+    auto corrected = cadu.correct();
+    expect(corrected == std::array{0, 0, 0, 0}, "changed: nothing corrected");
+    auto got = bytes(cadu);
+    expect(std::equal(got.begin(), got.begin() + sizeof(VC_PDU), changed.begin()), "changed: change kept");
+    expect(cadu._validate_checksum(), "changed: checksum recalculated");
+  }
+
+  if (failed) {
+    std::cerr << "FAIL: CADU correction" << '\n';
+    return 1;
+  }
+  std::cout << "PASS: CADU correction of received and changed frames" << '\n';
+}
@@ -0,0 +1,116 @@
+// Checks that CADUs can be shared between threads through their const
+// interface: several threads validate, read and copy out the same frames at
+// once, and must all see the same results as a single thread does. Built with
+// -fsanitize=thread, so any hidden write through the const interface is
+// reported as a data race.
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libcadu/libcadu.h"
+
+// What reading a CADU through its const interface gives
+struct Reading {
+  bool valid;
+  std::array<std::byte, 128> checksum;
+  VcduHeader header;
+  std::array<std::byte, 4 + sizeof(CVCDU)> copy;
+  std::string written;
+
+  auto operator==(Reading const & other) const -> bool {
+    return valid == other.valid && checksum == other.checksum && header.encode() == other.header.encode()
+        && copy == other.copy && written == other.written;
+  }
+};
+
+auto read(CADU const & cadu) -> Reading {
+  Reading reading;
+  reading.valid = cadu._validate_checksum();
+  reading.checksum = cadu.checksum();
+  reading.header = cadu.header();
+  cadu.copy_to(reading.copy);
+  std::ostringstream stream;
+  nonrandomised::operator<<(stream, cadu);
+  reading.written = stream.str();
+  return reading;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned threads = argc > 1 ? std::stoul(argv[1]) : 8;
+
+  // Frames with valid checksums, with checksums that don't match, and with
+  // dirty checksums, which are calculated afresh on each read
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<CADU> cadus;
+  for (int i = 0; i < 96; i++) {
+    std::array<std::uint8_t, sizeof(CVCDU)> received;
+    for (auto & b : received) {
+      b = byte(random);
+    }
+    CADU cadu(received.data());
+    switch (i % 3) {
+      case 0:
+        cadu.recalculate_checksum();
+        break;
+      case 1:
+        break;
+      case 2:
+        cadu.vcdu_counter() = i;
+        break;
+    }
+    cadus.push_back(cadu);
+  }
+  std::vector<CADU> const & shared = cadus;
+
+  std::vector<Reading> expected;
+  for (auto const & cadu : shared) {
+    expected.push_back(read(cadu));
+  }
+
+  std::vector<int> mismatches(threads);
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        for (int round = 0; round < 4; round++) {
+          for (std::size_t i = 0; i < shared.size(); i++) {
+            // Each thread starts at a different frame, so they overlap throughout
+            auto j = (i + t * 7) % shared.size();
+            if (!(read(shared[j]) == expected[j])) {
+              mismatches[t]++;
+            }
+          }
+        }
+      });
+    }
+  }
+
+  int failed = 0;
+  for (unsigned t = 0; t < threads; t++) {
+    if (mismatches[t]) {
+      std::cerr << "FAIL: thread " << t << " read " << mismatches[t] << " frames differently" << '\n';
+      failed++;
+    }
+  }
+  for (std::size_t i = 0; i < shared.size(); i++) {
+    if (shared[i].dirty() != (i % 3 == 2)) {
+      std::cerr << "FAIL: reading frame " << i << " changed whether its checksum is dirty" << '\n';
+      failed++;
+    }
+  }
+  if (!expected[0].valid || expected[1].valid || expected[2].valid) {
+    std::cerr << "FAIL: checksums validated wrongly" << '\n';
+    failed++;
+  }
+
+  std::cout << (failed ? "FAIL" : "PASS") << ": " << threads << " threads read " << shared.size()
+            << " shared CADUs through their const interface" << '\n';
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+// Checks CaduIndex::load on the index of a capture with junk between frames,
+// as built, and with its offsets tampered with: out of order, repeated,
+// overlapping, and running past the end of the capture. Only the index as
+// built may load, as the others cannot be of frames in the capture.
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "libcadu/index.h"
+
+int failed = 0;
+
+void expect(bool ok, std::string const & what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << '\n';
+    failed++;
+  }
+}
+
+constexpr int FRAMES = 8;
+
+// Overwrites the offset of entry i of an index file
+void set_offset(std::string const & path, std::size_t i, std::uint64_t offset) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(sizeof(CaduIndexHeader) + i * sizeof(CaduIndexEntry) + offsetof(CaduIndexEntry, offset));
+  file.write(reinterpret_cast<char const *>(&offset), sizeof(offset));
+}
+
+int main() {
+  auto capture = (std::filesystem::temp_directory_path() / "test_index.cadu").string();
+  auto index_path = CaduIndex::path_for(capture);
+  {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::ofstream output(capture, std::ios::binary | std::ios::trunc);
+    for (int n = 0; n < FRAMES; n++) {
+      if (n == 4) {
+        output.write("\x01\x02\x03", 3);
+      }
+      output.write(reinterpret_cast<char const *>(cadu::SYNC_MARKER_BYTES.data()), cadu::SYNC_MARKER_BYTES.size());
+      for (std::size_t i = 0; i < sizeof(CVCDU); i++) {
+        output.put(static_cast<char>(byte(random)));
+      }
+    }
+  }
+
+  auto built = CaduIndex::build(capture);
+  expect(built.size() == FRAMES, "built: every frame indexed");
+  built.save(capture);
+  auto loaded = CaduIndex::load(capture);
+  expect(loaded && loaded->offsets() == built.offsets(), "built: loads as saved");
+
+  auto last = built[FRAMES - 1].offset;
+  struct Tamper {
+    std::string what;
+    std::size_t entry;
+    std::uint64_t offset;
+  };
+  Tamper const tampered[] = {
+    {"out of order", 2, built[1].offset - 1},
+    {"repeated", 3, built[2].offset},
+    {"overlapping", 5, built[4].offset + CaduFile::FRAME_LEN - 1},
+    {"past the end", FRAMES - 1, last + 1},
+  };
+  for (auto const & tamper : tampered) {
+    built.save(capture);
+    set_offset(index_path, tamper.entry, tamper.offset);
+    expect(!CaduIndex::load(capture), tamper.what + ": rejected");
+  }
+
+  std::filesystem::remove(capture);
+  std::filesystem::remove(index_path);
+
+  if (failed) {
+    std::cerr << "FAIL: capture index" << '\n';
+    return 1;
+  }
+  std::cout << "PASS: capture index loading of valid and tampered offsets" << '\n';
+}
@@ -0,0 +1,202 @@
+// Checks PacketReassembler::push on a stream of packets cut into CADUs, as it
+// arrives whole, with a repeated frame, across a wrap of the VCDU counter,
+// with frames missing, and with the counter stepping backwards. Every packet
+// passed on must be one of those sent, in order unless a frame is replayed,
+// and the statistics must count each break as what it is.
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "libcadu/libcadu.h"
+#include "libcadu/packets.h"
+
+int failed = 0;
+
+void expect(bool ok, std::string const & what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << '\n';
+    failed++;
+  }
+}
+
+using Packet = std::vector<std::byte>;
+
+constexpr int FRAMES = 40;
+constexpr int COUNTER_MASK = (1 << cadu::VCDU_COUNTER_LEN) - 1;
+
+// Packets of varied lengths, some within a frame and some spanning several,
+// each with its index in its data, cut into the data of FRAMES CADUs
+struct Stream {
+  std::vector<Packet> packets;
+  std::vector<std::size_t> starts; // Where each packet starts in the stream
+  std::vector<std::byte> bytes;
+
+  Stream() {
+    std::size_t const lengths[] = {100, 500, 1500, 3, 884, 37, 2000, 6};
+    for (std::size_t i = 0; bytes.size() < FRAMES * cadu::DATA_LEN; i++) {
+      auto len = lengths[i % std::size(lengths)];
+      Packet packet(cadu::PACKET_PRIMARY_HEADER_LEN + len, std::byte(i & 0xff));
+      packet[0] = std::byte{0x08};
+      packet[1] = std::byte{0x40};
+      packet[2] = std::byte(i >> 8);
+      packet[3] = std::byte(i & 0xff);
+      packet[4] = std::byte((len - 1) >> 8);
+      packet[5] = std::byte((len - 1) & 0xff);
+      starts.push_back(bytes.size());
+      bytes.insert(bytes.end(), packet.begin(), packet.end());
+      packets.push_back(std::move(packet));
+    }
+  }
+
+  // The CADU carrying the given frame of the stream
+  auto frame(int n, int counter) const -> CADU {
+    CADU cadu;
+    cadu.vcid() = 30;
+    cadu.vcdu_counter() = counter & COUNTER_MASK;
+    auto first = static_cast<std::size_t>(n) * cadu::DATA_LEN;
+    auto start = std::lower_bound(starts.begin(), starts.end(), first);
+    cadu.first_header_pointer() = start != starts.end() && *start < first + cadu::DATA_LEN
+      ? static_cast<int>(*start - first) : cadu::NO_FIRST_HEADER;
+    std::array<std::byte, cadu::DATA_LEN> data;
+    std::copy_n(bytes.begin() + first, data.size(), data.begin());
+    cadu.data() = std::span(data);
+    return cadu;
+  }
+
+  // The packets that end within the given number of frames
+  auto complete(int frames) const -> std::vector<Packet> {
+    std::vector<Packet> complete;
+    for (std::size_t i = 0; i < packets.size(); i++) {
+      if (starts[i] + packets[i].size() <= static_cast<std::size_t>(frames) * cadu::DATA_LEN) {
+        complete.push_back(packets[i]);
+      }
+    }
+    return complete;
+  }
+};
+
+struct Result {
+  std::vector<Packet> packets;
+  ReassemblyStats stats;
+};
+
+auto reassemble(std::vector<CADU> const & cadus) -> Result {
+  PacketReassembler reassembler;
+  Result result;
+  for (auto const & cadu : cadus) {
+    reassembler.push(cadu, [&](int, std::span<std::byte const> packet) {
+      result.packets.emplace_back(packet.begin(), packet.end());
+    });
+  }
+  result.stats = reassembler.statistics();
+  return result;
+}
+
+// Whether every packet got was sent, in the order they were sent
+auto in_order(std::vector<Packet> const & got, std::vector<Packet> const & sent) -> bool {
+  auto next = sent.begin();
+  for (auto const & packet : got) {
+    next = std::find(next, sent.end(), packet);
+    if (next == sent.end()) {
+      return false;
+    }
+    next++;
+  }
+  return true;
+}
+
+// Whether every packet sent that ends within the given number of frames was got
+auto has_first(std::vector<Packet> const & got, Stream const & stream, int frames) -> bool {
+  auto before = stream.complete(frames);
+  return got.size() >= before.size() && std::equal(before.begin(), before.end(), got.begin());
+}
+
+int main() {
+  Stream stream;
+  auto all = stream.complete(FRAMES);
+
+  {
+    std::vector<CADU> cadus;
+    for (int n = 0; n < FRAMES; n++) {
+      cadus.push_back(stream.frame(n, n));
+    }
+    auto [packets, stats] = reassemble(cadus);
+    expect(packets == all, "whole stream: every complete packet passed on");
+    expect(stats.repeats == 0 && stats.gaps == 0 && stats.backward == 0 && stats.resyncs == 0,
+           "whole stream: no breaks counted");
+  }
+
+  {
+    std::vector<CADU> cadus;
+    for (int n = 0; n < FRAMES; n++) {
+      cadus.push_back(stream.frame(n, n));
+      if (n == 10) {
+        cadus.push_back(stream.frame(n, n));
+      }
+    }
+    auto [packets, stats] = reassemble(cadus);
+    expect(packets == all, "repeat: every complete packet passed on");
+    expect(stats.repeats == 1 && stats.gaps == 0 && stats.backward == 0, "repeat: counted as a repeat only");
+  }
+
+  {
+    std::vector<CADU> cadus;
+    for (int n = 0; n < FRAMES; n++) {
+      cadus.push_back(stream.frame(n, COUNTER_MASK - 19 + n));
+    }
+    auto [packets, stats] = reassemble(cadus);
+    expect(packets == all, "wrap: every complete packet passed on");
+    expect(stats.gaps == 0 && stats.frames_lost == 0 && stats.backward == 0, "wrap: no breaks counted");
+  }
+
+  {
+    std::vector<CADU> cadus;
+    for (int n = 0; n < FRAMES; n++) {
+      if (n != 10 && n != 11) {
+        cadus.push_back(stream.frame(n, n));
+      }
+    }
+    auto [packets, stats] = reassemble(cadus);
+    expect(in_order(packets, all) && has_first(packets, stream, 10) && packets.size() < all.size(),
+           "gap: packets before the gap passed on, and none made up");
+    expect(stats.gaps == 1 && stats.frames_lost == 2 && stats.backward == 0, "gap: two frames lost");
+  }
+
+  {
+    // The counter restarts part way through the stream
+    std::vector<CADU> cadus;
+    for (int n = 0; n < FRAMES; n++) {
+      cadus.push_back(stream.frame(n, n < 20 ? 1000 + n : n - 20));
+    }
+    auto [packets, stats] = reassemble(cadus);
+    expect(in_order(packets, all) && has_first(packets, stream, 20) && packets.size() < all.size(),
+           "backward: packets before the step passed on, and none made up");
+    expect(stats.backward == 1 && stats.gaps == 0 && stats.frames_lost == 0, "backward: no frames lost");
+  }
+
+  {
+    // A frame replayed one behind. The packets wholly within it are passed on
+    // again, as nothing tells them apart from new ones.
+    std::vector<CADU> cadus;
+    for (int n = 0; n < FRAMES; n++) {
+      cadus.push_back(stream.frame(n, n));
+      if (n == 10) {
+        cadus.push_back(stream.frame(n - 1, n - 1));
+      }
+    }
+    auto [packets, stats] = reassemble(cadus);
+    expect(has_first(packets, stream, 10), "replay: packets before the replay passed on");
+    expect(stats.backward == 1 && stats.gaps == 1 && stats.frames_lost == 1, "replay: one step back and one frame skipped");
+  }
+
+  if (failed) {
+    std::cerr << "FAIL: packet reassembly" << '\n';
+    return 1;
+  }
+  std::cout << "PASS: packet reassembly across repeats, gaps, backward steps and wraps" << '\n';
+}
@@ -0,0 +1,88 @@
+// Checks that a Pipeline passes chunks on in order whatever the number of
+// threads, and that an exception thrown by the transform or the sink is
+// rethrown once, without the chunk being passed on again afterwards
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "libcadu/pipeline.h"
+
+int failed = 0;
+
+void expect(bool ok, std::string const & what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << '\n';
+    failed++;
+  }
+}
+
+// Feeds items 0 to n - 1 through a pipeline in chunks of 4, returning how many
+// calls threw, and collecting what the sink saw
+auto run(unsigned threads, int n, int throw_in_transform, int throw_in_sink, std::vector<int> & seen) -> int {
+  Pipeline<int> pipeline(threads, [&](std::span<int> chunk) {
+    for (auto & item : chunk) {
+      if (item == throw_in_transform) {
+        throw std::runtime_error("transform");
+      }
+      item *= 10;
+    }
+  }, [&](std::span<int> chunk) {
+    for (auto item : chunk) {
+      if (item == throw_in_sink * 10) {
+        throw std::runtime_error("sink");
+      }
+      seen.push_back(item);
+    }
+  }, 4);
+
+  int thrown = 0;
+  for (int i = 0; i < n; i++) {
+    auto & chunk = pipeline.filling();
+    chunk.push_back(i);
+    if (chunk.size() == pipeline.chunk_size()) {
+      try {
+        pipeline.submit();
+      } catch (std::runtime_error const &) {
+        thrown++;
+      }
+    }
+  }
+  for (int attempt = 0; attempt < 3; attempt++) {
+    try {
+      pipeline.finish();
+    } catch (std::runtime_error const &) {
+      thrown++;
+    }
+  }
+  return thrown;
+}
+
+int main() {
+  for (unsigned threads : {1u, 2u, 4u, 8u}) {
+    auto name = std::to_string(threads) + " threads: ";
+
+    std::vector<int> seen;
+    expect(run(threads, 1001, -1, -1, seen) == 0, name + "threw without an error");
+    bool ordered = seen.size() == 1001;
+    for (std::size_t i = 0; ordered && i < seen.size(); i++) {
+      ordered = seen[i] == static_cast<int>(i) * 10;
+    }
+    expect(ordered, name + "chunks not passed on in order");
+
+    // The chunk holding 42, items 40 to 43, is dropped
+    seen.clear();
+    expect(run(threads, 1001, 42, -1, seen) == 1, name + "transform error not thrown exactly once");
+    expect(seen.size() == 997, name + "wrong number of items passed on around a transform error");
+
+    // Items 40 and 41 reach the sink before it throws
+    seen.clear();
+    expect(run(threads, 1001, -1, 42, seen) == 1, name + "sink error not thrown exactly once");
+    expect(seen.size() == 999, name + "wrong number of items passed on around a sink error");
+  }
+
+  std::cout << (failed ? "FAIL" : "PASS") << ": pipeline ordering and errors" << '\n';
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+// Checks that the native Reed-Solomon encoder is bit-exact with libfec's
+// encode_rs_ccsds, over random CVCDUs along with all-zero and all-ones ones.
+//
+// Then checks the decoder on random CVCDUs with 0 to 32 symbol errors in each
+// codeword: those with up to 16 must be restored exactly, with the number of
+// errors reported, and those with more reported as -1 and left as received.
+// Either way, the result must be the same as libfec's decode_rs_ccsds.
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+
+extern "C" {
+#include "fec.h"
+}
+
+#include "libcadu/reed_solomon.h"
+
+using Data = std::array<std::byte, cadu::rs::INTERLEAVE * cadu::rs::DATA_SYMBOLS>;
+using Parity = std::array<std::byte, cadu::rs::INTERLEAVE * cadu::rs::PARITY_SYMBOLS>;
+
+// Parity as libfec calculates it, a deinterleaved codeword at a time
+auto libfec_parity(Data const & data) -> Parity {
+  Parity parity;
+  for (int c = 0; c < cadu::rs::INTERLEAVE; c++) {
+    std::array<unsigned char, cadu::rs::DATA_SYMBOLS> codeword;
+    std::array<unsigned char, cadu::rs::PARITY_SYMBOLS> codeword_parity;
+    for (int i = 0; i < cadu::rs::DATA_SYMBOLS; i++) {
+      codeword[i] = std::to_integer<unsigned char>(data[cadu::rs::INTERLEAVE * i + c]);
+    }
+    encode_rs_ccsds(codeword.data(), codeword_parity.data(), 0);
+    for (int k = 0; k < cadu::rs::PARITY_SYMBOLS; k++) {
+      parity[cadu::rs::INTERLEAVE * k + c] = std::byte{codeword_parity[k]};
+    }
+  }
+  return parity;
+}
+
+auto native_parity(Data const & data) -> Parity {
+  Parity parity;
+  cadu::rs::encode(data, parity);
+  return parity;
+}
+
+// A CVCDU as received, its four codewords interleaved through data and parity
+struct Frame {
+  Data data;
+  Parity parity;
+
+  auto operator==(Frame const &) const -> bool = default;
+
+  // Symbol i of codeword c, counting the parity after the data
+  auto symbol(int c, int i) -> std::byte & {
+    return i < cadu::rs::DATA_SYMBOLS ? data[cadu::rs::INTERLEAVE * i + c]
+                                      : parity[cadu::rs::INTERLEAVE * (i - cadu::rs::DATA_SYMBOLS) + c];
+  }
+};
+
+// Corrects a frame as libfec does, a deinterleaved codeword at a time
+auto libfec_decode(Frame & frame) -> std::array<int, cadu::rs::INTERLEAVE> {
+  std::array<int, cadu::rs::INTERLEAVE> corrected;
+  for (int c = 0; c < cadu::rs::INTERLEAVE; c++) {
+    std::array<unsigned char, cadu::rs::SYMBOLS> codeword;
+    for (int i = 0; i < cadu::rs::SYMBOLS; i++) {
+      codeword[i] = std::to_integer<unsigned char>(frame.symbol(c, i));
+    }
+    corrected[c] = decode_rs_ccsds(codeword.data(), nullptr, 0, 0);
+    for (int i = 0; i < cadu::rs::SYMBOLS; i++) {
+      frame.symbol(c, i) = std::byte{codeword[i]};
+    }
+  }
+  return corrected;
+}
+
+int main(int argc, char *argv[]) {
+  int frames = argc > 1 ? std::stoi(argv[1]) : 10000;
+
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> byte(0, 255);
+  int failed = 0;
+  auto check = [&](Data const & data, std::string const & name) {
+    auto expected = libfec_parity(data);
+    auto parity = native_parity(data);
+    if (parity != expected) {
+      auto at = std::mismatch(parity.begin(), parity.end(), expected.begin()).first - parity.begin();
+      std::cerr << "FAIL: " << name << ": parity differs from libfec at byte " << at << '\n';
+      failed++;
+    }
+  };
+
+  Data data;
+  data.fill(std::byte{0x00});
+  check(data, "all-zero frame");
+  data.fill(std::byte{0xff});
+  check(data, "all-ones frame");
+  for (int i = 0; i < frames; i++) {
+    std::ranges::generate(data, [&] { return std::byte(byte(random)); });
+    check(data, "random frame " + std::to_string(i));
+  }
+
+  std::cout << (failed ? "FAIL" : "PASS") << ": " << frames + 2 - failed << " of " << frames + 2
+            << " frames encoded bit-exact with libfec" << '\n';
+
+  int decode_failed = 0;
+  std::array<int, cadu::rs::SYMBOLS> positions;
+  std::iota(positions.begin(), positions.end(), 0);
+  for (int n = 0; n < frames; n++) {
+    Frame sent;
+    std::ranges::generate(sent.data, [&] { return std::byte(byte(random)); });
+    sent.parity = native_parity(sent.data);
+
+    // Each codeword gets a different number of errors, at distinct symbols
+    auto received = sent;
+    std::array<int, cadu::rs::INTERLEAVE> errors;
+    for (int c = 0; c < cadu::rs::INTERLEAVE; c++) {
+      errors[c] = (n + 9 * c) % (cadu::rs::PARITY_SYMBOLS + 1);
+      std::ranges::shuffle(positions, random);
+      for (int e = 0; e < errors[c]; e++) {
+        received.symbol(c, positions[e]) ^= std::byte(std::uniform_int_distribution<int>(1, 255)(random));
+      }
+    }
+
+    auto native = received;
+    auto corrected = cadu::rs::decode(native.data, native.parity);
+    auto libfec = received;
+    auto libfec_corrected = libfec_decode(libfec);
+
+    bool ok = corrected == libfec_corrected && native == libfec;
+    for (int c = 0; c < cadu::rs::INTERLEAVE; c++) {
+      auto expected = errors[c] <= cadu::rs::MAX_CORRECTABLE ? sent : received;
+      for (int i = 0; i < cadu::rs::SYMBOLS; i++) {
+        ok &= native.symbol(c, i) == expected.symbol(c, i);
+      }
+      ok &= corrected[c] == (errors[c] <= cadu::rs::MAX_CORRECTABLE ? errors[c] : -1);
+    }
+    if (!ok) {
+      std::cerr << "FAIL: random frame " << n << " with " << errors[0] << ", " << errors[1] << ", " << errors[2]
+                << " and " << errors[3] << " errors: decoded as " << corrected[0] << ", " << corrected[1] << ", "
+                << corrected[2] << " and " << corrected[3] << '\n';
+      decode_failed++;
+    }
+  }
+
+  std::cout << (decode_failed ? "FAIL" : "PASS") << ": " << frames - decode_failed << " of " << frames
+            << " frames with 0 to 32 errors per codeword decoded as libfec does" << '\n';
+  return failed || decode_failed ? 1 : 0;
+}
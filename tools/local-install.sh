@@ -7,6 +7,10 @@ install -D -m 755 cadu_utils/bin/caduunpack ~/.local/bin/
 install -D -m 755 cadu_utils/bin/cadurandomise ~/.local/bin/
 install -D -m 755 cadu_utils/bin/caduhead ~/.local/bin/
 install -D -m 755 cadu_utils/bin/cadutail ~/.local/bin/
+install -D -m 755 cadu_utils/bin/caduindex ~/.local/bin/
+install -D -m 755 cadu_utils/bin/caducorrect ~/.local/bin/
+install -D -m 755 cadu_utils/bin/cadusync ~/.local/bin/
+install -D -m 755 cadu_utils/bin/cadurouter ~/.local/bin/
 install -D -m 755 ccsds_utils/bin/ccsdsinfo ~/.local/bin/
 install -D -m 755 ccsds_utils/bin/ccsdspack ~/.local/bin/
 install -D -m 755 ccsds_utils/bin/ccsdsunpack ~/.local/bin/
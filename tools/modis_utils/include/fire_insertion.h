@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <compare>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "libgiis/libgiis.h"
+#include "mask_region.h"
+
+// Counts to write into bands of a pixel, to make it look like a fire
+struct FireProfile {
+  struct Band {
+    int band;
+    int value;
+
+    auto operator<=>(Band const &) const = default;
+  };
+  std::vector<Band> bands;
+
+  auto operator==(FireProfile const &) const -> bool = default;
+};
+
+// A pixel to insert a fire into
+struct FirePixel {
+  int row;
+  int frame;
+  int ifov;
+  FireProfile profile;
+};
+
+// Inserts fires into the earth data of packets as they stream past.
+//
+// Pixels are grouped by the row and frame of the packet that carries them,
+// and the groups sorted, so finding the fires in a packet is a binary search,
+// and packets with none are left alone.
+class FireInsertion {
+public:
+  FireInsertion() = default;
+
+  explicit FireInsertion(std::vector<FirePixel> pixels) {
+    std::stable_sort(pixels.begin(), pixels.end(), [](auto const & a, auto const & b) {
+      return std::pair(a.row, a.frame) < std::pair(b.row, b.frame);
+    });
+    // Pixels usually share a profile, so each is only kept once
+    std::map<std::vector<FireProfile::Band>, std::size_t> indices;
+    for (auto const & pixel : pixels) {
+      if (frames.empty() || frames.back().row != pixel.row || frames.back().frame != pixel.frame) {
+        frames.push_back({pixel.row, pixel.frame, inserts.size(), 0});
+      }
+      auto [index, added] = indices.emplace(pixel.profile.bands, profiles.size());
+      if (added) {
+        profiles.push_back(pixel.profile);
+      }
+      inserts.push_back({pixel.ifov, index->second});
+      frames.back().count++;
+    }
+  }
+
+  auto empty() const -> bool {
+    return frames.empty();
+  }
+
+  // Writes the fires of the packet from the given row and frame into its data.
+  // Later pixels take precedence over earlier ones where they overlap.
+  void apply(giis::DataField & data_field, int row, int frame) const {
+    auto it = std::lower_bound(frames.begin(), frames.end(), std::pair(row, frame), [](auto const & group, auto const & key) {
+      return std::pair(group.row, group.frame) < key;
+    });
+    if (it == frames.end() || it->row != row || it->frame != frame) {
+      return;
+    }
+    for (auto i = it->first; i < it->first + it->count; i++) {
+      for (auto const & [band, value] : profiles[inserts[i].profile].bands) {
+        data_field.data_word(inserts[i].ifov, band) = value;
+      }
+    }
+  }
+
+private:
+  struct Frame {
+    int row;
+    int frame;
+    std::size_t first; // Index of the frame's first insert
+    std::size_t count;
+  };
+
+  struct Insert {
+    int ifov;
+    std::size_t profile;
+  };
+
+  std::vector<Frame> frames;
+  std::vector<Insert> inserts;
+  std::vector<FireProfile> profiles;
+};
+
+// MODIS data words hold 12 bit counts
+constexpr int MAX_COUNT = (1 << 12) - 1;
+
+// Bands of a pixel are told apart below this, by PixelRandom among others
+constexpr int MAX_BANDS = 1 << 8;
+
+// Parses a band's count given as band:value
+// Throws std::invalid_argument with a message suitable for the user
+inline auto parse_fire_band(std::string const & value) -> FireProfile::Band {
+  // The whole of each side must be the int, as stoi stops at the first character that isn't
+  auto to_int = [](std::string const & word) {
+    std::size_t end;
+    auto n = std::stoi(word, &end);
+    if (end != word.size()) {
+      throw std::invalid_argument(word);
+    }
+    return n;
+  };
+
+  auto colon = value.find(':');
+  FireProfile::Band band;
+  try {
+    if (colon == std::string::npos) {
+      throw std::invalid_argument(value);
+    }
+    band = {to_int(value.substr(0, colon)), to_int(value.substr(colon + 1))};
+  } catch (std::logic_error const &) {
+    throw std::invalid_argument("fire band must be band:value: " + value);
+  }
+  if (band.band < 0 || band.band >= MAX_BANDS) {
+    throw std::invalid_argument("fire band must be between 0 and " + std::to_string(MAX_BANDS - 1) + ": " + value);
+  }
+  if (band.value < 0 || band.value > MAX_COUNT) {
+    throw std::invalid_argument("fire value must be between 0 and " + std::to_string(MAX_COUNT) + ": " + value);
+  }
+  return band;
+}
+
+// Reads the pixels to insert fires into from a file, either a PBM bitmap as for
+// read_pixels, or a list of pixels, one per line as "row frame [ifov]
+// [band:value...]". Pixels without bands of their own get the given profile,
+// and a pixel without an IFOV is every IFOV of its frame.
+// Throws std::runtime_error with a message suitable for the user
+inline auto read_fire_pixels(std::string const & path, FireProfile const & profile) -> std::vector<FirePixel> {
+  std::vector<FirePixel> pixels;
+  auto add = [&](int row, int frame, std::uint8_t ifovs, FireProfile const & bands) {
+    for (int ifov = 1; ifov <= MaskRegion::IFOVS; ifov++) {
+      if (ifovs & (1 << (ifov - 1))) {
+        pixels.push_back({row, frame, ifov, bands});
+      }
+    }
+  };
+  auto check_profile = [&](FireProfile const & bands, std::string const & where) {
+    if (bands.bands.empty()) {
+      throw std::runtime_error(where + ": no bands for the fire, give them with --fire-band or on the line");
+    }
+  };
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("could not open fire pixel file " + path);
+  }
+  auto magic = std::string(2, '\0');
+  file.read(magic.data(), magic.size());
+  if (magic == "P1" || magic == "P4") {
+    check_profile(profile, path);
+    for (auto const & box : read_pixels(path)) {
+      for (int frame = box.frames.first; frame <= box.frames.last; frame++) {
+        add(box.rows.first, frame, box.ifovs, profile);
+      }
+    }
+    return pixels;
+  }
+
+  file.seekg(0);
+  std::string text;
+  for (int line_number = 1; std::getline(file, text); line_number++) {
+    auto where = path + ":" + std::to_string(line_number);
+    std::istringstream fields(text);
+    std::vector<std::string> words;
+    for (std::string word; fields >> word && !word.starts_with("#");) {
+      words.push_back(word);
+    }
+    if (words.empty()) {
+      continue;
+    }
+
+    auto to_int = [&](std::string const & word) {
+      try {
+        return std::stoi(word);
+      } catch (std::logic_error const &) {
+        throw std::runtime_error(where + ": expected \"row frame [ifov] [band:value...]\"");
+      }
+    };
+    if (words.size() < 2) {
+      throw std::runtime_error(where + ": expected \"row frame [ifov] [band:value...]\"");
+    }
+    auto row = to_int(words[0]);
+    auto frame = to_int(words[1]);
+    std::size_t next = 2;
+    std::uint8_t ifovs = MaskRegion::ALL_IFOVS;
+    if (next < words.size() && words[next].find(':') == std::string::npos) {
+      auto ifov = to_int(words[next++]);
+      if (ifov < 1 || ifov > MaskRegion::IFOVS) {
+        throw std::runtime_error(where + ": ifov must be between 1 and " + std::to_string(MaskRegion::IFOVS));
+      }
+      ifovs = 1 << (ifov - 1);
+    }
+    FireProfile bands;
+    for (; next < words.size(); next++) {
+      try {
+        bands.bands.push_back(parse_fire_band(words[next]));
+      } catch (std::invalid_argument const & ex) {
+        throw std::runtime_error(where + ": " + ex.what());
+      }
+    }
+    if (bands.bands.empty()) {
+      bands = profile;
+    }
+    check_profile(bands, where);
+    add(row, frame, ifovs, bands);
+  }
+  return pixels;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A set of pixels to mask, each a scan row, frame count and IFOV, built up from
+// boxes of them.
+//
+// Once indexed, the boxes are split into spans of rows, each holding the spans
+// of frames within them, along with which IFOVs are targeted in those frames,
+// so looking up a frame is two binary searches however many boxes there are.
+class MaskRegion {
+public:
+  static constexpr int IFOVS = 5;
+  static constexpr std::uint8_t ALL_IFOVS = (1 << IFOVS) - 1;
+  static constexpr int UNBOUNDED = std::numeric_limits<int>::max();
+
+  // Inclusive at both ends
+  struct Range {
+    int first = 0;
+    int last = UNBOUNDED;
+  };
+
+  struct Box {
+    Range rows;
+    Range frames;
+    std::uint8_t ifovs = ALL_IFOVS; // Bit i - 1 is set for IFOV i
+  };
+
+  // Boxes can be added in any order, and may overlap, but must all be added
+  // before the region is indexed
+  void add(Box const & box) {
+    if (box.ifovs != 0 && box.rows.first <= box.rows.last && box.frames.first <= box.frames.last) {
+      boxes.push_back(box);
+    }
+  }
+
+  void index() {
+    std::sort(boxes.begin(), boxes.end(), [](auto const & a, auto const & b) { return a.rows.first < b.rows.first; });
+
+    // Rows where the boxes covering them can change
+    std::vector<int> cuts;
+    for (auto const & box : boxes) {
+      cuts.push_back(box.rows.first);
+      if (box.rows.last != UNBOUNDED) {
+        cuts.push_back(box.rows.last + 1);
+      }
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    rows.clear();
+    std::vector<Box> active;
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < cuts.size(); i++) {
+      Range span {cuts[i], i + 1 < cuts.size() ? cuts[i + 1] - 1 : UNBOUNDED};
+      while (next < boxes.size() && boxes[next].rows.first <= span.first) {
+        active.push_back(boxes[next++]);
+      }
+      std::erase_if(active, [&](auto const & box) { return box.rows.last < span.first; });
+      if (active.empty()) {
+        continue;
+      }
+
+      auto frames = frame_spans(active);
+      if (!rows.empty() && rows.back().rows.last + 1 == span.first && rows.back().frames == frames) {
+        rows.back().rows.last = span.last;
+      } else {
+        rows.push_back({span, std::move(frames)});
+      }
+    }
+  }
+
+  auto empty() const -> bool {
+    return boxes.empty();
+  }
+
+  // The IFOVs targeted in a frame of a row, as bits, with bit i - 1 for IFOV i
+  auto ifovs(int row, int frame) const -> std::uint8_t {
+    auto row_span = find(rows, row, [](auto const & span) { return span.rows; });
+    if (row_span == rows.end()) {
+      return 0;
+    }
+    auto frame_span = find(row_span->frames, frame, [](auto const & span) { return span.frames; });
+    if (frame_span == row_span->frames.end()) {
+      return 0;
+    }
+    return frame_span->ifovs;
+  }
+
+private:
+  struct FrameSpan {
+    Range frames;
+    std::uint8_t ifovs;
+
+    auto operator==(FrameSpan const & other) const -> bool {
+      return frames.first == other.frames.first && frames.last == other.frames.last && ifovs == other.ifovs;
+    }
+  };
+
+  struct RowSpan {
+    Range rows;
+    std::vector<FrameSpan> frames;
+  };
+
+  std::vector<Box> boxes;
+  std::vector<RowSpan> rows;
+
+  // Splits the frames covered by boxes into spans targeting the same IFOVs, by
+  // sweeping over where each box starts and ends
+  static auto frame_spans(std::vector<Box> const & boxes) -> std::vector<FrameSpan> {
+    struct Edge {
+      long frame;
+      int step;
+      std::uint8_t ifovs;
+    };
+    std::vector<Edge> edges;
+    for (auto const & box : boxes) {
+      edges.push_back({box.frames.first, 1, box.ifovs});
+      edges.push_back({static_cast<long>(box.frames.last) + 1, -1, box.ifovs});
+    }
+    std::sort(edges.begin(), edges.end(), [](auto const & a, auto const & b) { return a.frame < b.frame; });
+
+    std::vector<FrameSpan> spans;
+    std::array<int, IFOVS> covering {};
+    for (std::size_t i = 0; i < edges.size();) {
+      auto frame = edges[i].frame;
+      for (; i < edges.size() && edges[i].frame == frame; i++) {
+        for (int ifov = 0; ifov < IFOVS; ifov++) {
+          if (edges[i].ifovs & (1 << ifov)) {
+            covering[ifov] += edges[i].step;
+          }
+        }
+      }
+
+      std::uint8_t ifovs = 0;
+      for (int ifov = 0; ifov < IFOVS; ifov++) {
+        if (covering[ifov] > 0) {
+          ifovs |= 1 << ifov;
+        }
+      }
+      if (ifovs == 0 || i == edges.size()) {
+        continue;
+      }
+      FrameSpan span {{static_cast<int>(frame), static_cast<int>(edges[i].frame - 1)}, ifovs};
+      if (!spans.empty() && spans.back().frames.last + 1 == span.frames.first && spans.back().ifovs == ifovs) {
+        spans.back().frames.last = span.frames.last;
+      } else {
+        spans.push_back(span);
+      }
+    }
+    return spans;
+  }
+
+  // The span containing value, among spans sorted and not overlapping
+  template <typename Span, typename F>
+  static auto find(std::vector<Span> const & spans, int value, F && range) -> typename std::vector<Span>::const_iterator {
+    auto it = std::upper_bound(spans.begin(), spans.end(), value, [&](int v, auto const & span) { return v < range(span).first; });
+    if (it == spans.begin()) {
+      return spans.end();
+    }
+    --it;
+    return range(*it).last >= value ? it : spans.end();
+  }
+};
+
+// Parses a range given as first-last, as a single value, or as * for any value,
+// where either end of first-last may be left out to leave it unbounded, and
+// first must not be after last
+// Throws std::invalid_argument with a message suitable for the user
+inline auto parse_range(std::string const & value, MaskRegion::Range any) -> MaskRegion::Range {
+  if (value.empty() || value == "*") {
+    return any;
+  }
+
+  MaskRegion::Range range;
+  try {
+    auto dash = value.find('-');
+    if (dash == std::string::npos) {
+      auto n = std::stoi(value);
+      return {n, n};
+    }
+    range = {
+      dash == 0 ? any.first : std::stoi(value.substr(0, dash)),
+      dash + 1 == value.size() ? any.last : std::stoi(value.substr(dash + 1)),
+    };
+  } catch (std::logic_error const &) {
+    throw std::invalid_argument("range must be first-last, a single int, or *: " + value);
+  }
+  if (range.first > range.last) {
+    throw std::invalid_argument("range must not end before it starts: " + value);
+  }
+  return range;
+}
+
+// Parses a box given as rows:frames[:ifovs], each a range for parse_range
+// Throws std::invalid_argument with a message suitable for the user
+inline auto parse_region(std::string const & value) -> MaskRegion::Box {
+  std::vector<std::string> parts;
+  std::istringstream stream(value);
+  for (std::string part; std::getline(stream, part, ':');) {
+    parts.push_back(part);
+  }
+  if (parts.size() < 2 || parts.size() > 3) {
+    throw std::invalid_argument("region must be rows:frames[:ifovs]: " + value);
+  }
+
+  MaskRegion::Box box;
+  box.rows = parse_range(parts[0], {});
+  box.frames = parse_range(parts[1], {});
+  if (parts.size() == 3) {
+    auto ifovs = parse_range(parts[2], {1, MaskRegion::IFOVS});
+    if (ifovs.first < 1 || ifovs.last > MaskRegion::IFOVS) {
+      throw std::invalid_argument("ifovs must be between 1 and " + std::to_string(MaskRegion::IFOVS) + ": " + value);
+    }
+    box.ifovs = 0;
+    for (int ifov = ifovs.first; ifov <= ifovs.last; ifov++) {
+      box.ifovs |= 1 << (ifov - 1);
+    }
+  }
+  return box;
+}
+
+// Reads target pixels from a file as boxes, either a PBM bitmap (P1 or
+// P4) with a line for each row and a column for each frame, from frame 1,
+// targeting every IFOV, or a list of pixels, one per line as "row frame" or
+// "row frame ifov"
+// Throws std::runtime_error with a message suitable for the user
+inline auto read_pixels(std::string const & path) -> std::vector<MaskRegion::Box> {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("could not open pixel file " + path);
+  }
+
+  std::vector<MaskRegion::Box> boxes;
+  auto magic = std::string(2, '\0');
+  file.read(magic.data(), magic.size());
+  if (magic == "P1" || magic == "P4") {
+    // Header fields are separated by whitespace, with comments to the end of the line
+    auto next_number = [&]() {
+      while (true) {
+        file >> std::ws;
+        if (file.peek() != '#') {
+          break;
+        }
+        file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+      }
+      int n = -1;
+      file >> n;
+      return n;
+    };
+    auto width = next_number();
+    auto height = next_number();
+    if (!file || width < 0 || height < 0) {
+      throw std::runtime_error("invalid PBM header in " + path);
+    }
+
+    std::vector<bool> line(width);
+    if (magic == "P4") {
+      // A single whitespace byte, then each line packed most significant bit first
+      file.get();
+    }
+    for (int row = 0; row < height; row++) {
+      if (magic == "P1") {
+        for (int x = 0; x < width; x++) {
+          char bit;
+          if (!(file >> bit) || (bit != '0' && bit != '1')) {
+            throw std::runtime_error("truncated or invalid PBM data in " + path);
+          }
+          line[x] = bit == '1';
+        }
+      } else {
+        std::vector<char> packed((width + 7) / 8);
+        if (!file.read(packed.data(), packed.size())) {
+          throw std::runtime_error("truncated PBM data in " + path);
+        }
+        for (int x = 0; x < width; x++) {
+          line[x] = packed[x / 8] & (0x80 >> (x % 8));
+        }
+      }
+
+      // Each run of target pixels is one box
+      for (int x = 0; x < width;) {
+        if (!line[x]) {
+          x++;
+          continue;
+        }
+        auto start = x;
+        while (x < width && line[x]) {
+          x++;
+        }
+        MaskRegion::Box box;
+        box.rows = {row, row};
+        box.frames = {start + 1, x};
+        boxes.push_back(box);
+      }
+    }
+    return boxes;
+  }
+
+  file.seekg(0);
+  std::string text;
+  for (int line_number = 1; std::getline(file, text); line_number++) {
+    std::istringstream fields(text);
+    int row, frame, ifov;
+    if (!(fields >> row)) {
+      // Blank lines and comments
+      if (text.find_first_not_of(" \t\r") == std::string::npos || text.find_first_not_of(" \t\r") == text.find('#')) {
+        continue;
+      }
+      throw std::runtime_error(path + ":" + std::to_string(line_number) + ": expected \"row frame [ifov]\"");
+    }
+    if (!(fields >> frame)) {
+      throw std::runtime_error(path + ":" + std::to_string(line_number) + ": expected \"row frame [ifov]\"");
+    }
+    MaskRegion::Box box;
+    box.rows = {row, row};
+    box.frames = {frame, frame};
+    if (fields >> ifov) {
+      if (ifov < 1 || ifov > MaskRegion::IFOVS) {
+        throw std::runtime_error(path + ":" + std::to_string(line_number) + ": ifov must be between 1 and " + std::to_string(MaskRegion::IFOVS));
+      }
+      box.ifovs = 1 << (ifov - 1);
+    }
+    boxes.push_back(box);
+  }
+  return boxes;
+}
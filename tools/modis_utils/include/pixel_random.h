@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "mask_region.h"
+
+// Random values for the bands of pixels from a counter-based generator: each
+// value is a hash of the seed with the pixel's row, frame, IFOV and band,
+// rather than the next value of a shared state, so a pixel gets the same value
+// however the stream is split up, and in whatever order pixels are visited.
+//
+// The hash is the SplitMix64 finaliser, and values are brought into range by
+// multiplying, which is biased by at most bound / 2^32.
+class PixelRandom {
+public:
+  explicit PixelRandom(std::uint64_t seed) : key{mix(seed)} {}
+
+  // A value in [0, bound) for a band of a pixel, where bound is positive
+  auto below(int row, int frame, int ifov, int band, int bound) const -> int {
+    auto bits = mix(counter(row, frame, ifov, band) * GOLDEN + key) >> 32;
+    return static_cast<int>((bits * static_cast<std::uint32_t>(bound)) >> 32);
+  }
+
+  // Values in [0, bound) for the given bands of the IFOVs of a frame set in
+  // ifovs, with bit i - 1 for IFOV i. Those of IFOV i are at
+  // out[(i - 1) * bands.size()], in the order of bands, and those of IFOVs not
+  // set are left as they are.
+  void fill(int row, int frame, std::uint8_t ifovs, std::span<int const> bands, int bound, std::span<int> out) const {
+    for (int ifov = 1; ifov <= MaskRegion::IFOVS; ifov++) {
+      if (!(ifovs & (1 << (ifov - 1)))) {
+        continue;
+      }
+      auto values = out.subspan((ifov - 1) * bands.size(), bands.size());
+      for (std::size_t i = 0; i < bands.size(); i++) {
+        values[i] = below(row, frame, ifov, bands[i], bound);
+      }
+    }
+  }
+
+private:
+  static constexpr std::uint64_t GOLDEN = 0x9e3779b97f4a7c15;
+
+  std::uint64_t key;
+
+  static constexpr auto mix(std::uint64_t z) -> std::uint64_t {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  // Each pixel band as a distinct integer, for frames and bands below 2^16
+  // and 2^8, which covers every MODIS packet
+  static constexpr auto counter(int row, int frame, int ifov, int band) -> std::uint64_t {
+    return static_cast<std::uint64_t>(static_cast<std::uint32_t>(row)) << 32
+         | static_cast<std::uint64_t>(frame & 0xffff) << 16
+         | static_cast<std::uint64_t>(ifov & 0xff) << 8
+         | static_cast<std::uint64_t>(band & 0xff);
+  }
+};
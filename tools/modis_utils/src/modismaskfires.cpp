@@ -1,43 +1,322 @@
 #include <iostream>
-#include <stdlib.h>    // rand
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <algorithm>   // min
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
 #include <cxxopts.hpp>
 
 #include "libccsds/libccsds.h"
 #include "libgiis/libgiis.h"
+#include "fire_insertion.h"
+#include "mask_region.h"
+#include "pixel_random.h"
 
 // TODO: select desired outputs through flags
 
-int main(int argc, char *argv[]) {
-  cxxopts::Options options("ccsdsinfo", "Displays the header contents of a CCSDS packet stream from stdin");
+using Packet = CCSDSPacket<giis::SecondaryHeader, giis::DataField>;
+
+// How to mask the fires in one output: which channels to set to a value,
+// randomise or cap, and which pixels, as given in the options, along with any
+// fires to insert afterwards
+struct MaskConfig {
+  std::string name;
+  std::vector<int> mask;
+  int mask_value;
+  std::vector<int> randomize;
+  int random_max;
+  std::uint64_t seed;
+  std::vector<int> cap;
+  int cap_max;
+  std::vector<MaskRegion::Box> targets; // Every pixel is masked if there are none
+  std::vector<FirePixel> fires;
+};
+
+// A MaskConfig compiled for masking packets: an index of the pixels to mask,
+// and a table of what to do to each channel, so masking a packet is one pass
+// over the channels with something to do, in only the IFOVs targeted, followed
+// by writing in the fires of its frame. It is not changed by masking, so can
+// be shared between threads.
+class MaskPlan {
+public:
+  // Channels are bands of a pixel
+  static constexpr int MAX_CHANNELS = MAX_BANDS;
+
+  explicit MaskPlan(MaskConfig const & config)
+    : everywhere{config.targets.empty()}, random{config.seed}, random_max{config.random_max}, fires{config.fires} {
+    for (auto const & box : config.targets) {
+      region.add(box);
+    }
+    region.index();
+
+    // Later options take precedence, as each was applied in turn: a channel is
+    // masked, then randomised, then capped
+    for (auto m : config.mask) {
+      if (m >= 0) {
+        action(m) = {Set::value, config.mask_value, action(m).cap};
+      }
+    }
+    for (auto r : config.randomize) {
+      if (r >= 0) {
+        action(r) = {Set::random, config.random_max, action(r).cap};
+      }
+    }
+    for (auto c : config.cap) {
+      if (c >= 0) {
+        action(c).cap = config.cap_max;
+      }
+    }
+
+    // Randomised channels come first, so their values can be drawn for a whole
+    // packet at once
+    for (auto r : config.randomize) {
+      if (r >= 0 && std::find(active.begin(), active.end(), r) == active.end()) {
+        active.push_back(r);
+      }
+    }
+    randomised = active.size();
+    for (int channel = 0; channel < static_cast<int>(channels.size()); channel++) {
+      if (channels[channel].set != Set::keep || channels[channel].cap) {
+        if (std::find(active.begin(), active.end(), channel) == active.end()) {
+          active.push_back(channel);
+        }
+      }
+    }
+  }
+
+  // Masks the earth data IR fields of a packet from the given row and frame,
+  // then inserts its fires, so they are not masked themselves
+  void apply(giis::DataField & data_field, int row, int frame) const {
+    mask(data_field, row, frame);
+    fires.apply(data_field, row, frame);
+  }
+
+private:
+  enum class Set { keep, value, random };
+
+  struct ChannelAction {
+    Set set = Set::keep;
+    int value = 0; // The value to set, or the bound of random values
+    std::optional<int> cap;
+  };
+
+  bool everywhere;
+  MaskRegion region;
+  std::vector<ChannelAction> channels; // Indexed by channel
+  std::vector<int> active; // Channels with an action, in the order they are masked
+  std::size_t randomised = 0; // How many channels at the start of active are randomised
+  PixelRandom random;
+  int random_max;
+  FireInsertion fires;
+
+  void mask(giis::DataField & data_field, int row, int frame) const {
+    auto ifovs = everywhere ? MaskRegion::ALL_IFOVS : region.ifovs(row, frame);
+    if (ifovs == 0) {
+      return;
+    }
+    // Drawn for the packet, for each IFOV in turn
+    std::array<int, MaskRegion::IFOVS * MAX_CHANNELS> random_values;
+    if (randomised > 0) {
+      random.fill(row, frame, ifovs, std::span(active).first(randomised), random_max, random_values);
+    }
+
+    for (int ifov=1; ifov<=5; ifov++) {
+      if (!(ifovs & (1 << (ifov - 1)))) {
+        continue;
+      }
+      for (std::size_t i = 0; i < active.size(); i++) {
+        auto channel = active[i];
+        auto const & action = channels[channel];
+        auto word = data_field.data_word(ifov, channel);
+        switch (action.set) {
+          case Set::keep:
+            break;
+          case Set::value:
+            word = action.value;
+            break;
+          case Set::random:
+            word = random_values[(ifov - 1) * randomised + i];
+            break;
+        }
+        if (action.cap) {
+          int data_word = word;
+          word = std::min(data_word, *action.cap);
+        }
+      }
+    }
+  }
+
+  // The action for a channel, which must not be negative
+  auto action(int channel) -> ChannelAction & {
+    auto index = static_cast<std::size_t>(channel);
+    if (index >= channels.size()) {
+      channels.resize(index + 1);
+    }
+    return channels[index];
+  }
+};
+
+// Adds the options that make up a MaskConfig, which are the same on the command
+// line and in a batch file
+void add_mask_options(cxxopts::Options & options) {
   options.add_options()
-    ("v,verbose", "Warn on non-fatal decoding errors")
-    ("h,help", "Print usage")
     ("m,mask", "Mask out the following channel with a uniform value (default 0, change using -V)", cxxopts::value<std::vector<int>>()->default_value("-1"))
     ("M,mask-value", "Value to which masked channels are set", cxxopts::value<int>()->default_value("0"))
     ("r,randomize", "Set the following channel to random values", cxxopts::value<std::vector<int>>()->default_value("-1"))
     ("R,random-max", "Set \"randomize\" channels to values in the range [0,M)", cxxopts::value<int>()->default_value("100"))
+    ("seed", "Seed for \"randomize\" values, each of which depends only on the seed and its pixel and channel", cxxopts::value<std::uint64_t>()->default_value("0"))
     ("c,cap", "Cap the following channel to a maximum of C", cxxopts::value<std::vector<int>>()->default_value("-1"))
     ("C,cap-max", "Cap the \"cap\" channels to a maximum of this value", cxxopts::value<int>()->default_value("100"))
-    ("mask-rows", "TODO describe", cxxopts::value<std::vector<int>>()->default_value("-1"))
+    ("mask-rows", "Only mask these scan rows, counting from 0 at the start of the stream", cxxopts::value<std::vector<int>>()->default_value("-1"))
+    (
+      "region",
+      "Only mask the pixels in this box, given as rows:frames[:ifovs], each a range first-last, a single int, or * for all. Frames are counted from 1 along each scan row, and IFOVs from 1 to 5 - <rows:frames[:ifovs]>",
+      cxxopts::value<std::vector<std::string>>()
+    )
+    (
+      "pixels",
+      "Only mask the pixels in this file, either a PBM bitmap with a line for each scan row and a column for each frame, or a list of pixels, one per line as \"row frame\" or \"row frame ifov\" - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "fire-pixels",
+      "Insert fires into the pixels in this file after masking, either a PBM bitmap as for --pixels, or a list of pixels, one per line as \"row frame [ifov] [band:value...]\", where the bands and their counts override --fire-band for that pixel - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "fire-band",
+      "Set this band to this count in every inserted fire, e.g. --fire-band 21:3000,22:3000,31:2000 - <band:value>",
+      cxxopts::value<std::vector<std::string>>()
+    )
     ;
+}
 
-  auto result = options.parse(argc, argv);
+// Rows, regions and pixels all add to the pixels masked
+// Throws std::invalid_argument or std::runtime_error with a message suitable for the user
+auto parse_mask_config(std::string name, cxxopts::ParseResult const & result) -> MaskConfig {
+  MaskConfig config;
+  config.name = std::move(name);
+  config.mask = result["mask"].as<std::vector<int>>();
+  config.mask_value = result["mask-value"].as<int>();
+  config.randomize = result["randomize"].as<std::vector<int>>();
+  config.random_max = result["random-max"].as<int>();
+  config.seed = result["seed"].as<std::uint64_t>();
+  config.cap = result["cap"].as<std::vector<int>>();
+  config.cap_max = result["cap-max"].as<int>();
+  for (auto const & channels : {config.mask, config.randomize, config.cap}) {
+    if (std::any_of(channels.begin(), channels.end(), [](int c) { return c >= MaskPlan::MAX_CHANNELS; })) {
+      throw std::invalid_argument("channels must be below " + std::to_string(MaskPlan::MAX_CHANNELS));
+    }
+  }
+  if (config.random_max <= 0 && std::any_of(config.randomize.begin(), config.randomize.end(), [](int r) { return r >= 0; })) {
+    throw std::invalid_argument("--random-max must be positive");
+  }
+  auto row_mask = result["mask-rows"].as<std::vector<int>>();
+  if (row_mask.size() > 0 && row_mask[0] != -1) {
+    for (auto row : row_mask) {
+      MaskRegion::Box box;
+      box.rows = {row, row};
+      config.targets.push_back(box);
+    }
+  }
+  if (result.count("region")) {
+    for (auto const & region : result["region"].as<std::vector<std::string>>()) {
+      config.targets.push_back(parse_region(region));
+    }
+  }
+  if (result.count("pixels")) {
+    auto pixels = read_pixels(result["pixels"].as<std::string>());
+    if (pixels.empty()) {
+      throw std::runtime_error("no pixels in " + result["pixels"].as<std::string>());
+    }
+    config.targets.insert(config.targets.end(), pixels.begin(), pixels.end());
+  }
+  FireProfile profile;
+  if (result.count("fire-band")) {
+    for (auto const & band : result["fire-band"].as<std::vector<std::string>>()) {
+      profile.bands.push_back(parse_fire_band(band));
+    }
+  }
+  if (result.count("fire-pixels")) {
+    config.fires = read_fire_pixels(result["fire-pixels"].as<std::string>(), profile);
+  } else if (!profile.bands.empty()) {
+    throw std::invalid_argument("--fire-band needs --fire-pixels to insert fires into");
+  }
+  return config;
+}
 
-  auto mask = result["mask"].as<std::vector<int>>();
-  int mask_value = result["mask-value"].as<int>();
+// Reads named mask configs from a file, one per line, each a name followed by
+// the masking options, as in fire_processing/args
+// Blank lines and lines starting with # are skipped, and names must be unique
+// Throws std::runtime_error with a message suitable for the user
+auto read_batch(std::string const & path) -> std::vector<MaskConfig> {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("could not open batch file " + path);
+  }
 
-  auto randomize = result["randomize"].as<std::vector<int>>();
-  int random_max = result["random-max"].as<int>();
+  std::vector<MaskConfig> configs;
+  std::map<std::string, int> names; // The line each name is given on
+  std::string line;
+  for (int line_number = 1; std::getline(file, line); line_number++) {
+    std::istringstream words(line);
+    std::vector<std::string> args {"modismaskfires"};
+    for (std::string word; words >> word;) {
+      args.push_back(word);
+    }
+    if (args.size() == 1 || args[1].starts_with("#")) {
+      continue;
+    }
 
-  auto cap = result["cap"].as<std::vector<int>>();
-  int cap_max = result["cap-max"].as<int>();
+    // The name takes the place of the program name, which the parser skips
+    auto name = args[1];
+    args.erase(args.begin() + 1);
+    if (auto [first, added] = names.emplace(name, line_number); !added) {
+      throw std::runtime_error(path + ":" + std::to_string(line_number) + ": configuration " + name + " is already given on line " + std::to_string(first->second));
+    }
+    std::vector<char *> argv;
+    for (auto & arg : args) {
+      argv.push_back(arg.data());
+    }
+    int argc = argv.size();
+    char ** argv_data = argv.data();
 
-  auto row_mask = result["mask-rows"].as<std::vector<int>>();
-  bool mask_rows = row_mask.size() > 0 && row_mask[0] != -1;
-  int row = 0;
-  int col = 0;
-  int col_prev = 1;
+    cxxopts::Options options("modismaskfires");
+    add_mask_options(options);
+    try {
+      configs.push_back(parse_mask_config(name, options.parse(argc, argv_data)));
+    } catch (std::exception const & ex) {
+      throw std::runtime_error(path + ":" + std::to_string(line_number) + ": " + ex.what());
+    }
+  }
+  return configs;
+}
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options options("modismaskfires", "Masks fires in the MODIS packet stream from stdin, and optionally inserts fake ones, writing the masked stream to stdout, or one masked stream per configuration in a batch");
+  options.add_options()
+    ("v,verbose", "Warn on non-fatal decoding errors")
+    ("h,help", "Print usage")
+    (
+      "b,batch",
+      "Mask the stream in several ways from a single pass over it, instead of with the masking options. Each line of the file is a name followed by masking options, as on the command line - <path>",
+      cxxopts::value<std::string>()
+    )
+    (
+      "o,output",
+      "Where to write each stream masked by --batch, with {} replaced by the name of its configuration - <path>",
+      cxxopts::value<std::string>()
+    )
+    ;
+  add_mask_options(options);
+
+  auto result = options.parse(argc, argv);
 
   // Show help menu
   if (result.count("help")) {
@@ -45,48 +324,110 @@ int main(int argc, char *argv[]) {
     exit(0);
   }
 
-  CCSDSPacket<giis::SecondaryHeader, giis::DataField> packet;
+  // Each output is written as its own masked copy of every packet
+  struct Output {
+    MaskPlan plan;
+    std::ostream * stream;
+    std::string path;
+  };
+  std::vector<Output> outputs;
+  std::vector<std::unique_ptr<std::ofstream>> files;
+
+  if (result.count("batch")) {
+    if (!result.count("output")) {
+      std::cerr << "Error: --batch needs an --output path" << '\n';
+      std::cerr << "Quitting..." << '\n';
+      exit(1);
+    }
+    auto output = result["output"].as<std::string>();
+    if (output.find("{}") == std::string::npos) {
+      std::cerr << "Error: --output must contain {} for the name of each configuration" << '\n';
+      std::cerr << "Quitting..." << '\n';
+      exit(1);
+    }
+
+    std::vector<MaskConfig> configs;
+    try {
+      configs = read_batch(result["batch"].as<std::string>());
+    } catch (std::runtime_error const & ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      std::cerr << "Quitting..." << '\n';
+      exit(1);
+    }
+
+    for (auto & config : configs) {
+      auto path = output;
+      for (auto at = path.find("{}"); at != std::string::npos; at = path.find("{}", at + config.name.size())) {
+        path.replace(at, 2, config.name);
+      }
+      files.push_back(std::make_unique<std::ofstream>(path, std::ios::binary));
+      if (!*files.back()) {
+        std::cerr << "Error: could not open " << path << '\n';
+        std::cerr << "Quitting..." << '\n';
+        exit(1);
+      }
+      outputs.push_back({MaskPlan(config), files.back().get(), path});
+    }
+  } else {
+    try {
+      outputs.push_back({MaskPlan(parse_mask_config("", result)), &std::cout, "stdout"});
+    } catch (std::exception const & ex) {
+      std::cerr << "Error: " << ex.what() << '\n';
+      std::cerr << "Quitting..." << '\n';
+      exit(1);
+    }
+  }
+
+  int row = 0;
+  int col = 0;
+  int col_prev = 1;
+
+  // Standard output is flushed after every packet, so a crash loses none of them
+  // TODO: when the segfaulting bug on operator >> is fixed, remove the flush
+  auto write = [](Output & output, Packet & packet) {
+    *output.stream << packet;
+    if (output.stream == &std::cout) {
+      *output.stream << std::flush;
+    }
+  };
+
+  // Each packet is parsed once, and masked for every output
+  Packet packet;
   while (std::cin >> packet) {
     // Only set earth data IR fields to zero
-    if (packet.data_field.src_ident_type() == 0 && packet.data_field.frame_data_count() != 0) {
+    bool earth_data = packet.data_field.src_ident_type() == 0 && packet.data_field.frame_data_count() != 0;
+    if (earth_data) {
       col = packet.data_field.frame_data_count();
       if (col == 1 && col_prev != 1) {
         row++;
       }
       col_prev = col;
+    }
 
-      for (int ifov=1; ifov<=5; ifov++) {
-        // Mask out the selected channels
-        for (auto m : mask) {
-          if (m >= 0) {
-            if (!mask_rows || std::find(std::begin(row_mask), std::end(row_mask), row) != std::end(row_mask)) {
-              //std::cout << row << "," << col << "," << ifov << std::endl;
-              packet.data_field.data_word(ifov, m) = mask_value;
-            }
-          }
-        }
-        for (auto r : randomize) {
-          if (r >= 0) {
-            if (!mask_rows || std::find(std::begin(row_mask), std::end(row_mask), row) != std::end(row_mask)) {
-              int rand_value = rand() % random_max;
-              packet.data_field.data_word(ifov, r) = rand_value;
-            }
-          }
-        }
-        for (auto c : cap) {
-          if (c >= 0) {
-            if (!mask_rows || std::find(std::begin(row_mask), std::end(row_mask), row) != std::end(row_mask)) {
-              int data_word = packet.data_field.data_word(ifov, c);
-              packet.data_field.data_word(ifov, c) = std::min(data_word, cap_max);
-            }
-          }
-        }
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+      auto & output = outputs[i];
+      if (!earth_data) {
+        write(output, packet);
+        continue;
+      }
+
+      // The last output can have the packet itself, as no other needs it afterwards
+      if (i + 1 == outputs.size()) {
+        output.plan.apply(packet.data_field, row, col);
+        write(output, packet);
+      } else {
+        auto masked = packet;
+        output.plan.apply(masked.data_field, row, col);
+        write(output, masked);
       }
-      //std::cout << row << std::endl;
-      //std::cout << packet.data_field.frame_data_count() << std::endl;
     }
+  }
 
-    // TODO: when the segfaulting bug on operator >> is fixed, remove the flush
-    std::cout << packet << std::flush;
+  // Files are only flushed at the end, where a failed write shows
+  for (auto & output : outputs) {
+    if (!output.stream->flush()) {
+      std::cerr << "Error: could not write " << output.path << '\n';
+      exit(1);
+    }
   }
 }